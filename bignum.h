@@ -0,0 +1,310 @@
+/* Bignum<Bits>, the number class of basic_impl.cpp, exp_opt.cpp and
+ * mult_opt.cpp, with the width as a template argument instead of the LEN
+ * and K macros each of them used to carry. Bignum<Bits> holds LEN = Bits/16
+ * 32-bit words, little endian, so a product of two Bits-bit numbers fits.
+ * Every loop runs to LEN or K, known at compile time, so the compiler
+ * builds (and can unroll) each width separately, as a build with the macros
+ * set to that width would, and one program can use several widths side by
+ * side. The exponentiation methods stay in the programs, as function
+ * templates over Bits.
+ */
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define MAX_UINT32  0xffffffff
+
+//#define NO_SPACE
+#define SHOW_ZERO
+
+template <int Bits>
+class Bignum {
+public:
+    enum {
+        LEN = Bits >> 4,    // 32-bit words, twice the width for the product
+        K = Bits            // number of bits is (LEN*32 / 2)
+    };
+private:
+    // 256 bits requires 8 elements, and 64 bits requires 2 elements.
+    uint32_t num[LEN]; // little endian
+public:
+    static uint32_t rand_uint32(uint32_t min, uint32_t max);
+    static int compare(const Bignum& b1, const Bignum& b2);
+public:
+    Bignum();
+    ~Bignum() {}
+    Bignum(uint32_t value);
+    Bignum(const Bignum& other);
+    Bignum& operator=(const Bignum& other);
+    void print() const;
+    int getBit(int bit) const;
+    int getTotalBits() const;
+    void genBignum();
+    Bignum add(const Bignum& other);
+    Bignum sub2(const Bignum& other); // num should be bigger than other.num
+    Bignum mult(const Bignum& other);
+    void shiftR();
+    void shiftL();
+    Bignum mod(const Bignum& modular);
+    Bignum multMod(const Bignum& other, const Bignum& n);
+};
+
+/* start of definition of member functions */
+
+template <int Bits>
+Bignum<Bits>::Bignum()
+{
+    memset(num, 0, sizeof(num));
+}
+
+template <int Bits>
+Bignum<Bits>::Bignum(uint32_t value)
+{
+    memset(num, 0, sizeof(num));
+    num[0] = value;
+}
+
+template <int Bits>
+Bignum<Bits>::Bignum(const Bignum& other)
+{
+    memcpy(num, other.num, sizeof(num));
+}
+
+template <int Bits>
+Bignum<Bits>& Bignum<Bits>::operator=(const Bignum& other)
+{
+    if (this != &other) {
+        memcpy(num, other.num, sizeof(num));
+    }
+    return *this;
+}
+
+template <int Bits>
+void Bignum<Bits>::print() const
+{
+    for(int i = LEN - 1; i >= 0; i--) {
+#ifndef SHOW_ZERO
+      if (num[i] != 0) {
+#endif
+#ifdef NO_SPACE
+        printf("%08x", num[i]);
+#else
+        printf("%08x ", num[i]);
+#endif
+#ifndef SHOW_ZERO
+      }
+#endif
+    }
+    printf("\n");
+}
+
+template <int Bits>
+int Bignum<Bits>::getBit(int bit) const
+{
+    uint32_t segment = num[bit>>5];
+    bit = bit & 31;  //TODO: optimize!!
+    uint32_t temp = 1 << bit;
+    segment = temp & segment;
+    if (temp == segment)        return 1;
+    else                        return 0;
+}
+
+template <int Bits>
+int Bignum<Bits>::getTotalBits() const
+{
+    int k = LEN*32 - 1;
+    while (0 == getBit(k))
+        k--;
+    return (k+1);
+}
+
+template <int Bits>
+int Bignum<Bits>::compare(const Bignum& b1, const Bignum& b2)
+{
+    int result = 0;
+    for(int i = LEN-1; i >= 0; i--) {
+        if ( b1.num[i] > b2.num[i] ) {
+            result = 1;
+            break;
+        }
+        else if (b1.num[i] < b2.num[i]) {
+            result = -1;
+            break;
+        }
+    }
+    return result;
+}
+
+template <int Bits>
+uint32_t Bignum<Bits>::rand_uint32(uint32_t min, uint32_t max)
+{
+    uint32_t result = 0;
+    if (min > max) {
+        printf("Bignum::gen wrong min and max\n");
+        return result;
+    }
+    uint64_t range = static_cast<uint64_t>(max) - static_cast<uint64_t>(min) + 1;
+    result = (uint32_t) ( ( rand() % range ) + min ); //TODO
+    return result;
+}
+
+template <int Bits>
+void Bignum<Bits>::genBignum()
+{
+    for (int i = 0; i < LEN >> 1; i++) {
+        num[i] = rand_uint32(0, MAX_UINT32);
+    }
+}
+
+template <int Bits>
+Bignum<Bits> Bignum<Bits>::add(const Bignum& other)
+{
+    Bignum result;
+    uint64_t temp;
+    uint64_t carry = 0;
+
+    for(int i = 0; i < LEN; i++) {
+        temp = static_cast<uint64_t>(num[i])
+               + static_cast<uint64_t>(other.num[i])
+               + carry;
+        carry = temp >> 32;
+        result.num[i] = temp & MAX_UINT32;
+    }
+    return result;
+}
+
+// sub2 will happen only if this->num is bigger than other.num
+template <int Bits>
+Bignum<Bits> Bignum<Bits>::sub2(const Bignum& other)
+{
+    Bignum result;
+    uint64_t temp;
+    uint64_t carry = 0;
+
+    for (int i = 0; i < LEN; i++) {
+        uint64_t num_a = static_cast<uint64_t>(this->num[i]);
+        uint64_t num_b = static_cast<uint64_t>(other.num[i]);
+        if ( num_a >= num_b + carry) {
+            temp = num_a - num_b - carry;
+            carry = 0;
+        }
+        else {
+            temp = num_a + MAX_UINT32 + 1 - num_b - carry;
+            carry = 1;
+        }
+        result.num[i] = static_cast<uint32_t>(temp);
+    }
+    return result;
+}
+
+// result = *this * other
+template <int Bits>
+Bignum<Bits> Bignum<Bits>::mult(const Bignum& other)
+{
+    Bignum result;
+    uint64_t t[LEN];
+    memset(t, 0, sizeof(t));
+
+    int s = LEN >> 1;
+    uint64_t carry;
+    uint64_t sum;
+    uint64_t temp; // temp = (Carry, Sum)
+    for (int i = 0; i < s; i++) {
+        carry = 0;
+        for (int j = 0; j < s; j++) {
+            temp = static_cast<uint64_t>(this->num[j]) *
+                   static_cast<uint64_t>(other.num[i]);
+            temp += t[i+j] + carry;
+            sum = temp & MAX_UINT32;
+            t[i+j] = static_cast<uint32_t>(sum);
+            carry = temp >> 32;
+        }
+        t[i + s] = carry;
+    }
+
+    for (int i = 0; i < LEN; i++) {
+        result.num[i] = t[i];
+    }
+
+    return result;
+}
+
+template <int Bits>
+void Bignum<Bits>::shiftR()
+{
+    uint32_t CONSTANT = 0x80000000;
+    uint32_t carry = 0;
+    for (int i = LEN-1; i >= 0; i--) {
+        uint32_t temp = num[i];
+        num[i] = num[i] >> 1;
+        num[i] += carry;
+        if(temp & 0x1 == 0x1)
+            carry = CONSTANT;
+        else
+            carry = 0;
+    }
+}
+
+template <int Bits>
+void Bignum<Bits>::shiftL()
+{
+    uint32_t CONSTANT = 0x80000000;
+    uint32_t carry = 0;
+    for (int i = 0; i < LEN; i++) {
+        uint32_t temp = num[i];
+        num[i] = (num[i] << 1) + carry;
+        temp = temp & CONSTANT;
+        if (temp == CONSTANT) {
+            carry = 1;
+        }
+        else {
+            carry = 0;
+        }
+    }
+}
+
+template <int Bits>
+Bignum<Bits> Bignum<Bits>::mod(const Bignum& modular)
+{
+    Bignum result;
+
+    Bignum n = modular;
+
+    Bignum t = *this;
+    // shift left n to align n with t
+    Bignum temp_n(n);
+    temp_n.shiftL();
+    int k = 1;  // k is the times that temp_n is being shifted left.
+    while ( compare(t, temp_n) >= 0 ) {
+        n = temp_n;
+        temp_n.shiftL();
+        k++;
+    }
+
+    Bignum R0 = t;
+    Bignum R1;
+    for (int i = 0; i < k; ++i) {
+        if ( compare(R0, n) >= 0 ) {
+            R1 = R0.sub2(n);
+            R0 = R1;
+        }
+        n.shiftR();
+    }
+    result = R1;
+
+    return result;
+}
+
+template <int Bits>
+Bignum<Bits> Bignum<Bits>::multMod(const Bignum& other, const Bignum& n)
+{
+    return this->mult(other).mod(n);
+}
+
+/* end of definition of member functions */
+
+#endif
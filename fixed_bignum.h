@@ -0,0 +1,308 @@
+/* fixed-width Montgomery arithmetic, for the modular products of modexp
+ * FixedBignum<Bits> is a number of exactly Bits/64 64-bit words, little
+ * endian. The word counts are template arguments, so the loops below have a
+ * trip count known at compile time and are compiled (and unrolled) for each
+ * width, and the Karatsuba split is resolved at compile time as well.
+ * FixedMontgomery<Bits> multiplies modulo one odd n of that width.
+ * The products and the reduction are rows of addmul taken from a Row class,
+ * FixedRow by default; a program can pass its own, e.g. an assembly row it
+ * picks at run time.
+ * Nothing here depends on the Bignum class of the programs, they convert
+ * to and from 64-bit words.
+ */
+#ifndef FIXED_BIGNUM_H
+#define FIXED_BIGNUM_H
+
+#include <cstdint>
+#include <cstring>
+
+#define FIXED_KARATSUBA_WORDS 24  // from here on, products of an even number of words split in halves
+
+#ifdef __SIZEOF_INT128__
+// hi:lo = a*b, returns lo
+static inline uint64_t fixed_mul_word64(uint64_t a, uint64_t b, uint64_t* hi)
+{
+    unsigned __int128 p = static_cast<unsigned __int128>(a) * b;
+    *hi = static_cast<uint64_t>(p >> 64);
+    return static_cast<uint64_t>(p);
+}
+#else
+// hi:lo = a*b, returns lo; 32x32 bit pieces
+static inline uint64_t fixed_mul_word64(uint64_t a, uint64_t b, uint64_t* hi)
+{
+    uint64_t a_lo = a & 0xffffffff, a_hi = a >> 32;
+    uint64_t b_lo = b & 0xffffffff, b_hi = b >> 32;
+    uint64_t p0 = a_lo * b_lo, p1 = a_lo * b_hi;
+    uint64_t p2 = a_hi * b_lo, p3 = a_hi * b_hi;
+    uint64_t mid = (p0 >> 32) + (p1 & 0xffffffff) + (p2 & 0xffffffff);
+    *hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+    return (mid << 32) | (p0 & 0xffffffff);
+}
+#endif
+
+template <int Bits>
+struct FixedBignum {
+    enum { WORDS = Bits / 64 };
+    uint64_t w[WORDS];
+};
+
+// word loops over N words
+template <int N>
+struct FixedWords {
+    // r = a + b, returns the carry
+    static uint64_t add(uint64_t* r, const uint64_t* a, const uint64_t* b)
+    {
+        uint64_t carry = 0;
+        for (int i = 0; i < N; i++) {
+            uint64_t sum = a[i] + carry;
+            carry = (sum < carry);
+            r[i] = sum + b[i];
+            carry += (r[i] < sum);
+        }
+        return carry;
+    }
+
+    // r = a - b, returns the borrow
+    static uint64_t sub(uint64_t* r, const uint64_t* a, const uint64_t* b)
+    {
+        uint64_t borrow = 0;
+        for (int i = 0; i < N; i++) {
+            uint64_t diff = a[i] - b[i];
+            uint64_t next = (a[i] < b[i]);
+            next += (diff < borrow);
+            r[i] = diff - borrow;
+            borrow = next;
+        }
+        return borrow;
+    }
+
+    // r += c, returns the carry
+    static uint64_t add_1(uint64_t* r, uint64_t c)
+    {
+        for (int i = 0; i < N && 0 != c; i++) {
+            r[i] += c;
+            c = (r[i] < c);
+        }
+        return c;
+    }
+
+    static int compare(const uint64_t* a, const uint64_t* b)
+    {
+        for (int i = N-1; i >= 0; i--) {
+            if (a[i] != b[i])
+                return (a[i] > b[i]) ? 1 : -1;
+        }
+        return 0;
+    }
+
+    // r += a*b, returns the carry word; the row of FixedRow, unrolled by 8
+    static uint64_t addmul(uint64_t* r, const uint64_t* a, uint64_t b)
+    {
+        uint64_t carry = 0;
+#pragma GCC unroll 8
+        for (int i = 0; i < N; i++) {
+            uint64_t hi;
+            uint64_t lo = fixed_mul_word64(a[i], b, &hi);
+            lo += carry;
+            hi += (lo < carry);
+            r[i] += lo;
+            carry = hi + (r[i] < lo);
+        }
+        return carry;
+    }
+
+    // r = |a - b|, returns 1 if a < b
+    static int abs_diff(uint64_t* r, const uint64_t* a, const uint64_t* b)
+    {
+        if (compare(a, b) < 0) {
+            sub(r, b, a);
+            return 1;
+        }
+        sub(r, a, b);
+        return 0;
+    }
+};
+
+// the portable addmul row: r[0..n-1] += a*b, returns the carry word
+struct FixedRow {
+    // n = N, known at compile time
+    template <int N>
+    static uint64_t addmul_fixed(uint64_t* r, const uint64_t* a, uint64_t b)
+    {
+        return FixedWords<N>::addmul(r, a, b);
+    }
+
+    static uint64_t addmul(uint64_t* r, const uint64_t* a, int n, uint64_t b)
+    {
+        uint64_t carry = 0;
+        for (int i = 0; i < n; i++) {
+            uint64_t hi;
+            uint64_t lo = fixed_mul_word64(a[i], b, &hi);
+            lo += carry;
+            hi += (lo < carry);
+            r[i] += lo;
+            carry = hi + (r[i] < lo);
+        }
+        return carry;
+    }
+};
+
+// r = a*b and r = a^2, 2N words; schoolbook below FIXED_KARATSUBA_WORDS
+template <int N, class Row = FixedRow, bool Split = (N >= FIXED_KARATSUBA_WORDS && 0 == N % 2)>
+struct FixedMul {
+    static void mul(uint64_t* r, const uint64_t* a, const uint64_t* b)
+    {
+        memset(r, 0, N * sizeof(uint64_t));
+        for (int i = 0; i < N; i++)
+            r[N + i] = Row::template addmul_fixed<N>(r + i, a, b[i]);
+    }
+
+    // the products a[i]*a[j], i < j, doubled, plus the squares a[i]^2
+    static void sqr(uint64_t* r, const uint64_t* a)
+    {
+        memset(r, 0, 2 * N * sizeof(uint64_t));
+        for (int i = 0; i < N-1; i++)
+            r[i+N] = Row::addmul(r + 2*i + 1, a + i + 1, N - i - 1, a[i]);
+        uint64_t top = 0;
+        for (int i = 0; i < 2*N; i++) {
+            uint64_t next = r[i] >> 63;
+            r[i] = (r[i] << 1) | top;
+            top = next;
+        }
+        uint64_t carry = 0;
+        for (int i = 0; i < N; i++) {
+            uint64_t hi;
+            uint64_t lo = fixed_mul_word64(a[i], a[i], &hi);
+            uint64_t sum = r[2*i] + carry;
+            carry = (sum < carry);
+            r[2*i] = sum + lo;
+            carry += (r[2*i] < lo);
+            sum = r[2*i+1] + carry;
+            carry = (sum < carry);
+            r[2*i+1] = sum + hi;
+            carry += (r[2*i+1] < hi);
+        }
+    }
+};
+
+// Karatsuba on the halves of L = N/2 words:
+// a*b = z0 + (z0 + z2 - (a0-a1)(b0-b1))*B^L + z2*B^N
+template <int N, class Row>
+struct FixedMul<N, Row, true> {
+    enum { L = N / 2 };
+
+    static void mul(uint64_t* r, const uint64_t* a, const uint64_t* b)
+    {
+        uint64_t da[L], db[L], z1[N], mid[N];
+        int neg = FixedWords<L>::abs_diff(da, a, a + L) ^ FixedWords<L>::abs_diff(db, b, b + L);
+        FixedMul<L, Row>::mul(r, a, b);
+        FixedMul<L, Row>::mul(r + N, a + L, b + L);
+        FixedMul<L, Row>::mul(z1, da, db);
+        combine(r, z1, mid, !neg);
+    }
+
+    static void sqr(uint64_t* r, const uint64_t* a)
+    {
+        uint64_t da[L], z1[N], mid[N];
+        FixedWords<L>::abs_diff(da, a, a + L);
+        FixedMul<L, Row>::sqr(r, a);
+        FixedMul<L, Row>::sqr(r + N, a + L);
+        FixedMul<L, Row>::sqr(z1, da);
+        combine(r, z1, mid, true);
+    }
+
+    // r[L..] += z0 + z2 -/+ z1, z0 and z2 are in r
+    static void combine(uint64_t* r, const uint64_t* z1, uint64_t* mid, bool subtract)
+    {
+        uint64_t carry = FixedWords<N>::add(mid, r, r + N);
+        if (subtract)
+            carry -= FixedWords<N>::sub(mid, mid, z1);
+        else
+            carry += FixedWords<N>::add(mid, mid, z1);
+        carry += FixedWords<N>::add(r + L, r + L, mid);
+        FixedWords<L>::add_1(r + L + N, carry);
+    }
+};
+
+// Montgomery product modulo an odd n of WORDS words, R = 2^Bits
+template <int Bits, class Row = FixedRow>
+class FixedMontgomery {
+public:
+    enum { WORDS = Bits / 64 };
+
+    explicit FixedMontgomery(const uint64_t* modular)
+    {
+        memcpy(n, modular, sizeof(n));
+        // n_prime = -n^(-1) mod 2^64, Newton: every step doubles the correct bits
+        uint64_t inv = n[0];
+        for (int i = 0; i < 5; i++)
+            inv *= 2 - n[0] * inv;
+        n_prime = 0 - inv;
+        // R mod n, then R^2 mod n = R*2^Bits, by doublings
+        memset(r1, 0, sizeof(r1));
+        r1[0] = 1;
+        for (int i = 0; i < Bits; i++)
+            double_mod(r1);
+        memcpy(r2, r1, sizeof(r2));
+        for (int i = 0; i < Bits; i++)
+            double_mod(r2);
+    }
+
+    // r = a*b*R^(-1) mod n, a, b < n; r may alias a or b
+    void mult(uint64_t* r, const uint64_t* a, const uint64_t* b) const
+    {
+        uint64_t t[2*WORDS];
+        FixedMul<WORDS, Row>::mul(t, a, b);
+        reduce(r, t);
+    }
+
+    void sqr(uint64_t* r, const uint64_t* a) const
+    {
+        uint64_t t[2*WORDS];
+        FixedMul<WORDS, Row>::sqr(t, a);
+        reduce(r, t);
+    }
+
+    void to_mont(uint64_t* r, const uint64_t* a) const { mult(r, a, r2); }
+
+    void from_mont(uint64_t* r, const uint64_t* a) const
+    {
+        uint64_t t[2*WORDS];
+        memcpy(t, a, WORDS * sizeof(uint64_t));
+        memset(t + WORDS, 0, WORDS * sizeof(uint64_t));
+        reduce(r, t);
+    }
+
+    void one(uint64_t* r) const { memcpy(r, r1, sizeof(r1)); }
+
+private:
+    uint64_t n[WORDS], r1[WORDS], r2[WORDS];
+    uint64_t n_prime;
+
+    // r = 2r mod n, r < n
+    void double_mod(uint64_t* r) const
+    {
+        uint64_t top = FixedWords<WORDS>::add(r, r, r);
+        if (0 != top || FixedWords<WORDS>::compare(r, n) >= 0)
+            FixedWords<WORDS>::sub(r, r, n);
+    }
+
+    // r = t*R^(-1) mod n, t < n*R; each step clears a low word of t
+    void reduce(uint64_t* r, uint64_t* t) const
+    {
+        uint64_t carry = 0;
+        for (int i = 0; i < WORDS; i++) {
+            uint64_t c = Row::template addmul_fixed<WORDS>(t + i, n, t[i] * n_prime);
+            uint64_t sum = t[i + WORDS] + c;
+            uint64_t next = (sum < c);
+            t[i + WORDS] = sum + carry;
+            carry = next + (t[i + WORDS] < sum);
+        }
+        if (0 != carry || FixedWords<WORDS>::compare(t + WORDS, n) >= 0)
+            FixedWords<WORDS>::sub(r, t + WORDS, n);
+        else
+            memcpy(r, t + WORDS, WORDS * sizeof(uint64_t));
+    }
+};
+
+#endif
@@ -4,502 +4,4808 @@
  * 1) standard multiplication + binary method;
  * 2) standard multiplication + m-ary method;
  * 3) Blakley's shift-add method + binary method;
+ * 4) Montgomery multiplication + binary / m-ary method;
  */
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
 #include <cstdio>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <deque>
+#include <mutex>
 #include <string>
-#include <sys/time.h>
+#include <thread>
 #include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "fixed_bignum.h"
+#if defined(__x86_64__) && defined(__GNUC__)
+#define KERNEL_DISPATCH     // the ADX, AVX2 and IFMA kernels are built and picked at run time
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
-#define LEN         64
-//  256 bits: LEN should be 16
-//  512 bits: LEN should be 32
-// 1024 bits: LEN should be 64
-// 2048 bits: LEN should be 128
-// 4096 bits: LEN should be 256
-// 8192 bits: LEN should be 512
-//16384 bits: LEN should be 1024
-#define K           (LEN<<4)  // number of bits is (LEN*32 / 2)
+#define LEN         1024  // capacity in words, a product needs twice the operand
+#define MAX_BITS    (LEN<<4)  // largest operand: 16384 bits
 #define MAX_UINT32  0xffffffff
 #define M_ARY       8
+#define MAX_WINDOW  10    // widest sliding window, the table has 2^(w-1) entries
+#define COMB_TEETH  6     // fixed-base comb: 2^h entries per table
+#define COMB_TABLES 2     // fixed-base comb: number of tables
+#define MAX_TEETH   12
+#define MAX_TABLES  16
+#define MAX_THREADS 256
+#define MAX_MULTI_EXP 4   // bases sharing one joint table in multi-exponentiation
+#define MULTI_EXP_TABLE_BITS 6  // joint table: at most 2^6 entries
+#define CT_MAX_WINDOW 5   // constant-time fixed window: every window scans 2^w entries
+#define SIEVE_PRIMES 2048 // odd primes the prime candidates are sieved with
+#define SIEVE_WINDOW 4096 // odd candidates per sieve window
+#define MIN_PRIME_BITS 16 // the candidates stay above the sieve primes
+#define SECURE_RANDOM_WORDS 64 // words per read of the kernel random source
+#define STREAM_CHUNK      32        // records per unit of work of the streaming batch
+#define STREAM_IN_FLIGHT  4         // chunks per worker between the reader and the writer
+#define STREAM_READ_BYTES (1 << 20) // stdin buffer, and the output buffer
+#define BENCH_MIN_BITS  256
+#define BENCH_SEED      1     // benchmark inputs are the same from run to run
+#define BENCH_TRIAL_SECONDS 1e-3  // fast operations are repeated to fill a trial
+#define BENCH_CASE_SECONDS  0.25  // trials per case stop here, once there are BENCH_MIN_TRIALS
+#define BENCH_MIN_TRIALS    3
+#define BENCH_MAX_TRIALS    201
 
 //#define NO_SPACE
 #define SHOW_ZERO
+//#define BIGNUM_COUNTERS
 
-class Bignum {
-    // 256 bits requires 8 elements, and 64 bits requires 2 elements.
-    uint32_t num[LEN]; // little endian
-public:
-    static uint32_t rand_uint32(uint32_t min, uint32_t max);
-    static int compare(const Bignum& b1, const Bignum& b2);
-    static Bignum Blakley_shiftadd(const Bignum& a, const Bignum& b, const Bignum& n);
-public:
-    Bignum();
-    ~Bignum() {}
-    Bignum(uint32_t value);
-    Bignum(const Bignum& other);
-    Bignum& operator=(const Bignum& other);
-    void print() const;
-    int getBit(int bit) const;
-    int getTotalBits() const;
-    void genBignum();
-    Bignum add(const Bignum& other);
-    Bignum sub2(const Bignum& other); // num should be bigger than other.num
-    Bignum mult(const Bignum& other);
-    void shiftR();
-    void shiftL();
-    void block_shiftL(int block);
-    Bignum mod(const Bignum& modular);
-    Bignum multMod(const Bignum& other, const Bignum& n);
-    Bignum mod_exp_binary(const Bignum& exp, const Bignum& n);
-    Bignum mod_exp_binary_Blakley_shiftadd(const Bignum& exp, const Bignum& n);
-    Bignum mod_exp_mary(const Bignum& exp, const Bignum& n);
-    Bignum mod_exp_mary_Blakley_shiftadd(const Bignum& exp, const Bignum& n);
-    void decompose_exp(const Bignum& exp, int r, vector<uint32_t>& F, int s);
+/* operation counters
+ * With BIGNUM_COUNTERS defined (-DBIGNUM_COUNTERS), the Bignum primitives,
+ * the reducer products and the correction steps of the reductions count
+ * their calls, so two methods can be compared by the work they do and not
+ * only by their time. Otherwise COUNT() is empty. The counters are per
+ * thread, the batch workers do not share them.
+ */
+enum OpCounter {
+    OP_ADD, OP_SUB2, OP_MULT, OP_SQUARE, OP_MOD, OP_DIVMOD, OP_MULTMOD,
+    OP_SHIFTL, OP_SHIFTR, OP_COMPARE,
+    OP_RED_MULT,    // reducer multiplications
+    OP_RED_SQR,     // reducer squarings
+    OP_RED_SUB,     // subtractions of n: Montgomery final, Barrett and Blakley corrections
+    OP_ADD_BACK,    // quotient estimate one too large, the divisor added back
+    OP_COUNTERS
 };
 
-/* start of definition of member functions */
+static const char* const op_counter_names[OP_COUNTERS] = {
+    "add", "sub2", "mult", "square", "mod", "divmod", "multMod",
+    "shiftL", "shiftR", "compare", "red_mult", "red_sqr", "red_sub", "add_back"
+};
 
-Bignum::Bignum()
-{
-    memset(num, 0, sizeof(num));
-}
+struct OpCounters {
+    uint64_t count[OP_COUNTERS];
+};
 
-Bignum::Bignum(uint32_t value)
+static thread_local OpCounters op_counters;
+
+#ifdef BIGNUM_COUNTERS
+static const bool op_counters_enabled = true;
+#define COUNT(op)   (++op_counters.count[op])
+#else
+static const bool op_counters_enabled = false;
+#define COUNT(op)   ((void)0)
+#endif
+
+/* start of definition of 64-bit word kernels
+ * Numbers are arrays of 64-bit words, little endian.  The inner loops do
+ * 64x64->128 bit products, so a 2048-bit operand takes 32 iterations
+ * instead of 64, and a product 1024 instead of 4096.
+ */
+
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 uint128_t;
+#endif
+
+// r = a + b, n words, returns the carry
+static uint64_t add_words64(uint64_t* r, const uint64_t* a, const uint64_t* b, int n)
 {
-    memset(num, 0, sizeof(num));
-    num[0] = value;
+    uint64_t carry = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t sum = a[i] + carry;
+        carry = (sum < carry);
+        r[i] = sum + b[i];
+        carry += (r[i] < sum);
+    }
+    return carry;
 }
 
-Bignum::Bignum(const Bignum& other)
+// r = a - b, n words, returns the borrow
+static uint64_t sub_words64(uint64_t* r, const uint64_t* a, const uint64_t* b, int n)
 {
-    memcpy(num, other.num, sizeof(num));
+    uint64_t borrow = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t diff = a[i] - b[i];
+        uint64_t next = (a[i] < b[i]);
+        next += (diff < borrow);
+        r[i] = diff - borrow;
+        borrow = next;
+    }
+    return borrow;
 }
 
-Bignum& Bignum::operator=(const Bignum& other)
+static int compare_words64(const uint64_t* a, const uint64_t* b, int n)
 {
-    if (this != &other) {
-        memcpy(num, other.num, sizeof(num));
+    for (int i = n-1; i >= 0; i--) {
+        if (a[i] != b[i])
+            return (a[i] > b[i]) ? 1 : -1;
     }
-    return *this;
+    return 0;
 }
 
-void Bignum::print() const
+#ifdef KERNEL_DISPATCH
+// r[0..n-1] += a[0..n-1] * b, returns the carry word, n > 0.
+// mulx leaves the flags alone, so the high halves ride on CF (adcx) and the
+// low halves on OF (adox): two independent carry chains in one pass.
+// Only called when CPUID reports BMI2 and ADX.
+static uint64_t addmul_adx_words64(uint64_t* r, const uint64_t* a, int n, uint64_t b)
 {
-    for(int i = LEN - 1; i >= 0; i--) {
-#ifndef SHOW_ZERO
-      if (num[i] != 0) {
+    uint64_t carry = 0;
+    uint64_t lo, hi, t;
+    long i = -static_cast<long>(n);
+    r += n;
+    a += n;
+    __asm__ volatile (
+        "xor   %[lo], %[lo]\n\t"            // clear CF and OF
+        "1:\n\t"
+        "mulx  (%[a],%[i],8), %[lo], %[hi]\n\t"
+        "mov   (%[r],%[i],8), %[t]\n\t"
+        "adox  %[lo], %[t]\n\t"
+        "adcx  %[c], %[t]\n\t"
+        "mov   %[t], (%[r],%[i],8)\n\t"
+        "mov   %[hi], %[c]\n\t"
+        "lea   1(%[i]), %[i]\n\t"           // lea and jrcxz keep the flags
+        "jrcxz 2f\n\t"
+        "jmp   1b\n\t"
+        "2:\n\t"
+        "mov   $0, %[t]\n\t"
+        "adox  %[t], %[c]\n\t"
+        "adcx  %[t], %[c]\n\t"
+        : [c] "+&r" (carry), [i] "+&c" (i),
+          [lo] "=&r" (lo), [hi] "=&r" (hi), [t] "=&r" (t)
+        : [a] "r" (a), [r] "r" (r), "d" (b)
+        : "cc", "memory");
+    return carry;
+}
 #endif
-#ifdef NO_SPACE
-        printf("%08x", num[i]);
+
+#if defined(__SIZEOF_INT128__)
+// r[0..n-1] += a[0..n-1] * b, returns the carry word
+static uint64_t addmul_generic_words64(uint64_t* r, const uint64_t* a, int n, uint64_t b)
+{
+    uint64_t carry = 0;
+    for (int i = 0; i < n; i++) {
+        uint128_t temp = static_cast<uint128_t>(a[i]) * b + r[i] + carry;
+        r[i] = static_cast<uint64_t>(temp);
+        carry = static_cast<uint64_t>(temp >> 64);
+    }
+    return carry;
+}
 #else
-        printf("%08x ", num[i]);
-#endif
-#ifndef SHOW_ZERO
-      }
-#endif
+// r[0..n-1] += a[0..n-1] * b, returns the carry word; 32x32 bit pieces
+static uint64_t addmul_generic_words64(uint64_t* r, const uint64_t* a, int n, uint64_t b)
+{
+    uint64_t carry = 0;
+    uint64_t b_lo = b & MAX_UINT32, b_hi = b >> 32;
+    for (int i = 0; i < n; i++) {
+        uint64_t a_lo = a[i] & MAX_UINT32, a_hi = a[i] >> 32;
+        uint64_t p0 = a_lo * b_lo, p1 = a_lo * b_hi;
+        uint64_t p2 = a_hi * b_lo, p3 = a_hi * b_hi;
+        uint64_t mid = (p0 >> 32) + (p1 & MAX_UINT32) + (p2 & MAX_UINT32);
+        uint64_t lo = (mid << 32) | (p0 & MAX_UINT32);
+        uint64_t hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+        lo += r[i];
+        hi += (lo < r[i]);
+        lo += carry;
+        hi += (lo < carry);
+        r[i] = lo;
+        carry = hi;
     }
-    printf("\n");
+    return carry;
 }
+#endif
 
-int Bignum::getBit(int bit) const
+typedef uint64_t (*AddmulFn)(uint64_t* r, const uint64_t* a, int n, uint64_t b);
+
+/* word kernels picked at run time
+ * The kernels that are rows of addmul (schoolbook product and square, the
+ * Montgomery rows and reduction) are templates on the row, built once per
+ * row kernel, so the row is inlined in each. select_kernels() binds the
+ * best set for the CPU once at startup; the names below call through it.
+ */
+struct WordKernels {
+    const char* name;
+    AddmulFn addmul;
+    void (*mult)(uint64_t* r, const uint64_t* a, int na, const uint64_t* b, int nb);
+    void (*sqr)(uint64_t* r, const uint64_t* a, int n);
+    void (*mont_rows)(const uint64_t* a, const uint64_t* b,
+                      const uint64_t* n, uint64_t n_prime, int s, uint64_t* t);
+    void (*mont_reduce)(uint64_t* t, const uint64_t* n, uint64_t n_prime, int s);
+};
+
+static const WordKernels* word_kernels;
+
+static uint64_t addmul_words64(uint64_t* r, const uint64_t* a, int n, uint64_t b)
 {
-    uint32_t segment = num[bit>>5];
-    bit = bit & 31;  //TODO: optimize!!
-    uint32_t temp = 1 << bit;
-    segment = temp & segment;
-    if (temp == segment)        return 1;
-    else                        return 0;
+    return word_kernels->addmul(r, a, n, b);
 }
 
-int Bignum::getTotalBits() const
+// (hi*2^64 + lo) / d, hi < d
+#if defined(__SIZEOF_INT128__)
+static uint64_t div_words64(uint64_t hi, uint64_t lo, uint64_t d)
 {
-    int k = LEN*32 - 1;
-    while (0 == getBit(k))
-        k--;
-    return (k+1);
+    return static_cast<uint64_t>(((static_cast<uint128_t>(hi) << 64) | lo) / d);
 }
-
-int Bignum::compare(const Bignum& b1, const Bignum& b2)
+#else
+// one quotient bit per step
+static uint64_t div_words64(uint64_t hi, uint64_t lo, uint64_t d)
 {
-    int result = 0;
-    for(int i = LEN-1; i >= 0; i--) {
-        if ( b1.num[i] > b2.num[i] ) {
-            result = 1;
-            break;
-        }
-        else if (b1.num[i] < b2.num[i]) {
-            result = -1;
-            break;
+    uint64_t q = 0;
+    for (int i = 0; i < 64; i++) {
+        uint64_t top = hi >> 63;
+        hi = (hi << 1) | (lo >> 63);
+        lo <<= 1;
+        q <<= 1;
+        if (0 != top || hi >= d) {
+            hi -= d;
+            q |= 1;
         }
     }
-    return result;
+    return q;
 }
+#endif
 
-uint32_t Bignum::rand_uint32(uint32_t min, uint32_t max)
+// a*b, returns the high word and stores the low word in lo
+#if defined(__SIZEOF_INT128__)
+static uint64_t mul_word64(uint64_t a, uint64_t b, uint64_t* lo)
 {
-    uint32_t result = 0;
-    if (min > max) {
-        printf("Bignum::gen wrong min and max\n");
-        return result;
-    }
-    uint64_t range = static_cast<uint64_t>(max) - static_cast<uint64_t>(min) + 1;
-    result = (uint32_t) ( ( rand() % range ) + min ); //TODO
-    return result;
+    uint128_t p = static_cast<uint128_t>(a) * b;
+    *lo = static_cast<uint64_t>(p);
+    return static_cast<uint64_t>(p >> 64);
+}
+#else
+static uint64_t mul_word64(uint64_t a, uint64_t b, uint64_t* lo)
+{
+    *lo = 0;
+    return addmul_generic_words64(lo, &a, 1, b);
 }
+#endif
 
-void Bignum::genBignum()
+// r = a * b, r has na + nb words and must not overlap a or b
+template <AddmulFn addmul>
+static void mult_words64_t(uint64_t* r, const uint64_t* a, int na, const uint64_t* b, int nb)
 {
-    for (int i = 0; i < LEN >> 1; i++) {
-        num[i] = rand_uint32(0, MAX_UINT32);
-    }
+    memset(r, 0, na * sizeof(uint64_t));
+    for (int i = 0; i < nb; i++)
+        r[i + na] = addmul(r + i, a, na, b[i]);
 }
 
-Bignum Bignum::add(const Bignum& other)
+static void mult_words64(uint64_t* r, const uint64_t* a, int na, const uint64_t* b, int nb)
 {
-    Bignum result;
-    uint64_t temp;
-    uint64_t carry = 0;
+    word_kernels->mult(r, a, na, b, nb);
+}
 
-    for(int i = 0; i < LEN; i++) {
-        temp = static_cast<uint64_t>(num[i]) 
-               + static_cast<uint64_t>(other.num[i])
-               + carry;
-        carry = temp >> 32;
-        result.num[i] = temp & MAX_UINT32;
+// r[0..n-1] += c, returns the carry out of the top word
+static uint64_t add_1_words64(uint64_t* r, int n, uint64_t c)
+{
+    for (int i = 0; i < n && c != 0; i++) {
+        r[i] += c;
+        c = (r[i] < c);
     }
-    return result;
+    return c;
 }
 
-// sub2 will happen only if this->num is bigger than other.num
-Bignum Bignum::sub2(const Bignum& other)
+// |a - b| into r (na words), a has na >= nb words; returns 1 if a < b
+static int abs_diff_words64(uint64_t* r, const uint64_t* a, int na, const uint64_t* b, int nb)
 {
-    Bignum result;
-    uint64_t temp;
-    uint64_t carry = 0;
-
-    for (int i = 0; i < LEN; i++) {
-        uint64_t num_a = static_cast<uint64_t>(this->num[i]);
-        uint64_t num_b = static_cast<uint64_t>(other.num[i]);
-        if ( num_a >= num_b + carry) {
-            temp = num_a - num_b - carry;
-            carry = 0;
-        }
-        else {
-            temp = num_a + MAX_UINT32 + 1 - num_b - carry;
-            carry = 1;
+    int i = na - 1;
+    while (i >= nb && 0 == a[i])
+        i--;
+    int less = 0;
+    if (i < nb) {
+        for (; i >= 0 && a[i] == b[i]; i--)
+            ;
+        less = (i >= 0 && a[i] < b[i]);
+    }
+    if (less) {
+        sub_words64(r, b, a, nb);
+        for (i = nb; i < na; i++)
+            r[i] = 0;
+    }
+    else {
+        uint64_t borrow = sub_words64(r, a, b, nb);
+        memcpy(r + nb, a + nb, (na - nb) * sizeof(uint64_t));
+        for (i = nb; i < na && borrow != 0; i++) {
+            borrow = (r[i] == 0);
+            r[i]--;
         }
-        result.num[i] = static_cast<uint32_t>(temp);
     }
-    return result;
+    return less;
 }
 
-// result = *this * other
-Bignum Bignum::mult(const Bignum& other)
+// r = a >> 1, n words
+static void rshift1_words64(uint64_t* r, const uint64_t* a, int n)
 {
-    Bignum result;
-    uint64_t t[LEN];
-    memset(t, 0, sizeof(t));
+    for (int i = 0; i < n - 1; i++)
+        r[i] = (a[i] >> 1) | (a[i+1] << 63);
+    r[n-1] = a[n-1] >> 1;
+}
 
-    int s = LEN >> 1;
-    uint64_t carry;
-    uint64_t sum;
-    uint64_t temp; // temp = (Carry, Sum)
-    for (int i = 0; i < s; i++) {
-        carry = 0;
-        for (int j = 0; j < s; j++) {
-            temp = static_cast<uint64_t>(this->num[j]) *
-                   static_cast<uint64_t>(other.num[i]);
-            temp += t[i+j] + carry;
-            sum = temp & MAX_UINT32;
-            t[i+j] = static_cast<uint32_t>(sum);
-            carry = temp >> 32;
-        }
-        t[i + s] = carry;
+// r = a / 3 for a multiple of 3 in two's complement, n words.
+// Multiplying by 3^(-1) mod 2^64 gives each quotient word; the borrow into the
+// next word is the high word of q*3, read off from the size of q.
+static void divexact3_words64(uint64_t* r, const uint64_t* a, int n)
+{
+    const uint64_t INV3 = 0xaaaaaaaaaaaaaaabULL;       // 3 * INV3 = 1 mod 2^64
+    const uint64_t ONE_THIRD = 0x5555555555555556ULL;  // ceil(2^64 / 3)
+    const uint64_t TWO_THIRDS = 0xaaaaaaaaaaaaaaabULL; // ceil(2^65 / 3)
+    uint64_t c = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t s = a[i];
+        uint64_t l = s - c;
+        c = (l > s);
+        uint64_t q = l * INV3;
+        r[i] = q;
+        c += (q >= ONE_THIRD) + (q >= TWO_THIRDS);
     }
+}
 
-    for (int i = 0; i < LEN; i++) {
-        result.num[i] = t[i];
-    }
+#define KARATSUBA_THRESHOLD 24   // in 64-bit words, below it schoolbook is faster
+#define TOOM3_THRESHOLD     128  // in 64-bit words, from here Toom-3 beats Karatsuba
 
-    return result;
-}
+static int karatsuba_threshold = KARATSUBA_THRESHOLD;
+static int toom3_threshold = TOOM3_THRESHOLD;
+static int window_width = 0;    // sliding window width, 0 picks it from the exponent
+static int comb_teeth = COMB_TEETH;
+static int comb_tables = COMB_TABLES;
 
-void Bignum::shiftR()
+static void mult_toom3_words64(uint64_t* r, const uint64_t* a, const uint64_t* b, int n,
+                               uint64_t* scratch);
+static void sqr_karatsuba_words64(uint64_t* r, const uint64_t* a, int n, uint64_t* scratch);
+
+// scratch words of a product of two n-word numbers at the current
+// thresholds, the most any of the Karatsuba kernels (plain, squaring,
+// constant time) or Toom-3 can use: each level takes its temporaries
+// (6l+1 words for Karatsuba on halves of l words, 14(k+1) for Toom-3 on
+// thirds of k) and passes the rest down, so it is about 7n
+static int mult_scratch_words(int n)
 {
-    uint32_t CONSTANT = 0x80000000;
-    uint32_t carry = 0;
-    for (int i = LEN-1; i >= 0; i--) {
-        uint32_t temp = num[i];
-        num[i] = num[i] >> 1;
-        num[i] += carry;
-        if(temp & 0x1 == 0x1) 
-            carry = CONSTANT;
-        else 
-            carry = 0;
+    if (n < karatsuba_threshold)
+        return 0;
+    int l = (n + 1) >> 1;
+    int words = 6*l + 1 + mult_scratch_words(l);
+    if (n >= toom3_threshold) {
+        int k = (n + 2) / 3;
+        int toom3 = 14*(k+1) + mult_scratch_words(k+1);
+        if (toom3 > words)
+            words = toom3;
     }
+    return words;
 }
 
-void Bignum::shiftL()
+// r = a * b, a and b have n words, r has 2n words. Karatsuba with the
+// subtractive middle term: a0*b1 + a1*b0 = a0*b0 + a1*b1 - (a0-a1)*(b0-b1).
+// scratch has mult_scratch_words(n) words.
+static void mult_karatsuba_words64(uint64_t* r, const uint64_t* a, const uint64_t* b, int n,
+                                   uint64_t* scratch)
 {
-    uint32_t CONSTANT = 0x80000000;
-    uint32_t carry = 0;
-    for (int i = 0; i < LEN; i++) {
-        uint32_t temp = num[i];
-        num[i] = (num[i] << 1) + carry;
-        temp = temp & CONSTANT;
-        if (temp == CONSTANT) {
-            carry = 1;
-        }
-        else {
-            carry = 0;
-        }
+    if (n < karatsuba_threshold) {
+        mult_words64(r, a, n, b, n);
+        return;
+    }
+    if (n >= toom3_threshold) {
+        mult_toom3_words64(r, a, b, n, scratch);
+        return;
     }
+    int l = (n + 1) >> 1;   // low half, the high half has h <= l words
+    int h = n - l;
+    uint64_t* da = scratch;       // |a0 - a1|, l words
+    uint64_t* db = da + l;        // |b0 - b1|, l words
+    uint64_t* z1 = db + l;        // da * db, 2l words
+    uint64_t* next = z1 + 2*l;
+    int neg = abs_diff_words64(da, a, l, a + l, h) ^ abs_diff_words64(db, b, l, b + l, h);
+    mult_karatsuba_words64(r, a, b, l, next);                   // z0 = a0*b0
+    mult_karatsuba_words64(r + 2*l, a + l, b + l, h, next);     // z2 = a1*b1
+    mult_karatsuba_words64(z1, da, db, l, next);
+
+    // mid = z0 + z2 -/+ z1, added into r at word l
+    uint64_t* mid = next;
+    memcpy(mid, r, 2*l * sizeof(uint64_t));
+    mid[2*l] = add_1_words64(mid + 2*h, 2*l - 2*h, add_words64(mid, mid, r + 2*l, 2*h));
+    if (neg)
+        mid[2*l] += add_words64(mid, mid, z1, 2*l);
+    else
+        mid[2*l] -= sub_words64(mid, mid, z1, 2*l);
+    int m = (2*l + 1 < l + 2*h) ? 2*l + 1 : l + 2*h;  // mid fits in l+h+1 words
+    add_1_words64(r + l + m, l + 2*h - m, add_words64(r + l, r + l, mid, m));
 }
 
-// the Bignum is kbits, wants to shift left by blocks
-void Bignum::block_shiftL(int block)
+// r = a * b, a and b have n words, r has 2n words, Toom-3 with the points
+// 0, 1, -1, 2 and infinity. The products at the points are interpolated in
+// two's complement with w = 2k+2 words, only the value at -1 can be negative.
+// scratch has mult_scratch_words(n) words.
+static void toom3_point_words64(uint64_t* r, const uint64_t* x, const uint64_t* y, int n,
+                                uint64_t* scratch, bool square)
 {
-    for (int i = LEN-1; i >= block; i--) {
-        num[i] = num[i - block];
-    }
-    for (int i = block-1; i >= 0; i--) {
-        num[i] = 0;
-    }
+    if (square)
+        sqr_karatsuba_words64(r, x, n, scratch);
+    else
+        mult_karatsuba_words64(r, x, y, n, scratch);
 }
 
-Bignum Bignum::mod(const Bignum& modular)
+static void mult_toom3_words64(uint64_t* r, const uint64_t* a, const uint64_t* b, int n,
+                               uint64_t* scratch)
 {
-    Bignum result;
-    Bignum R[K+1];
-    R[0] = *this;
-
-    Bignum n = modular;
-
-    Bignum t = *this;
-    // shift left n to align n with t
-    Bignum temp_n(n);
-    temp_n.shiftL();
-    int k = 1;  // k is the times that temp_n is being shifted left.
-    while ( compare(t, temp_n) >= 0 ) {
-        n = temp_n;
-        temp_n.shiftL();
-        k++;
+    int k = (n + 2) / 3;    // part size, the top part has h <= k words
+    int h = n - 2*k;
+    int w = 2*k + 2;
+    uint64_t* pa1  = scratch;       // a0 + a1 + a2
+    uint64_t* pam1 = pa1 + (k+1);   // |a0 - a1 + a2|
+    uint64_t* pa2  = pam1 + (k+1);  // a0 + 2*a1 + 4*a2
+    uint64_t* pb1  = pa2 + (k+1);
+    uint64_t* pbm1 = pb1 + (k+1);
+    uint64_t* pb2  = pbm1 + (k+1);
+    uint64_t* v1   = pb2 + (k+1);
+    uint64_t* vm1  = v1 + w;
+    uint64_t* v2   = vm1 + w;
+    uint64_t* t    = v2 + w;        // w words
+    uint64_t* next = t + w;
+
+    int neg = 0;
+    for (int side = 0; side < 2; side++) {
+        const uint64_t* x = side ? b : a;
+        uint64_t* p1  = side ? pb1 : pa1;
+        uint64_t* pm1 = side ? pbm1 : pam1;
+        uint64_t* p2  = side ? pb2 : pa2;
+        // t = x0 + x2, k+1 words
+        memcpy(t, x, k * sizeof(uint64_t));
+        t[k] = add_1_words64(t + h, k - h, add_words64(t, t, x + 2*k, h));
+        // p1 = t + x1, pm1 = |t - x1|
+        memcpy(p1, t, (k+1) * sizeof(uint64_t));
+        p1[k] += add_words64(p1, p1, x + k, k);
+        neg ^= abs_diff_words64(pm1, t, k+1, x + k, k);
+        // p2 = x0 + 2*x1 + 4*x2
+        memcpy(p2, x, k * sizeof(uint64_t));
+        p2[k] = addmul_words64(p2, x + k, k, 2);
+        p2[k] += add_1_words64(p2 + h, k - h, addmul_words64(p2, x + 2*k, h, 4));
     }
 
-    Bignum R0 = t;
-    Bignum R1;
-    for (int i = 0; i < k; ++i) {
-        if ( compare(R0, n) >= 0 ) {
-            R1 = R0.sub2(n);
-            R0 = R1;
-        }
-        n.shiftR();
+    // for a square (a == b) the five products are squares too
+    bool square = (a == b);
+    toom3_point_words64(r, a, b, k, next, square);                   // v0 = a0*b0
+    memset(r + 2*k, 0, 2*k * sizeof(uint64_t));
+    toom3_point_words64(r + 4*k, a + 2*k, b + 2*k, h, next, square); // vinf = a2*b2
+    toom3_point_words64(v1, pa1, pb1, k+1, next, square);
+    toom3_point_words64(vm1, pam1, pbm1, k+1, next, square);
+    toom3_point_words64(v2, pa2, pb2, k+1, next, square);
+    if (neg) {  // vm1 = -vm1
+        for (int i = 0; i < w; i++)
+            vm1[i] = ~vm1[i];
+        add_1_words64(vm1, w, 1);
     }
-    result = R1;
 
-    return result;
+    // interpolation, ci are the coefficients of X^i, X = 2^(64k)
+    sub_words64(v2, v2, vm1, w);
+    divexact3_words64(v2, v2, w);           // v2 = c1 + c2 + 3c3 + 5c4
+    sub_words64(vm1, v1, vm1, w);
+    rshift1_words64(vm1, vm1, w);           // vm1 = c1 + c3
+    memcpy(t, r, 2*k * sizeof(uint64_t));
+    t[2*k] = t[2*k+1] = 0;
+    sub_words64(v1, v1, t, w);              // v1 = c1 + c2 + c3 + c4
+    sub_words64(v2, v2, v1, w);
+    rshift1_words64(v2, v2, w);             // v2 = c3 + 2c4
+    memset(t, 0, w * sizeof(uint64_t));
+    memcpy(t, r + 4*k, 2*h * sizeof(uint64_t));
+    sub_words64(v1, v1, vm1, w);
+    sub_words64(v1, v1, t, w);              // v1 = c2
+    sub_words64(v2, v2, t, w);
+    sub_words64(v2, v2, t, w);              // v2 = c3
+    sub_words64(vm1, vm1, v2, w);           // vm1 = c1
+
+    // r = c0 + c1*X + c2*X^2 + c3*X^3 + c4*X^4, c0 and c4 are in place
+    const uint64_t* c[3] = { vm1, v1, v2 };
+    for (int i = 1; i <= 3; i++) {
+        int off = i*k;
+        int len = (w < 2*n - off) ? w : 2*n - off;
+        add_1_words64(r + off + len, 2*n - off - len, add_words64(r + off, r + off, c[i-1], len));
+    }
 }
 
-Bignum Bignum::multMod(const Bignum& other, const Bignum& n)
+// scratch words of mult_fast_words64 on na and nb words
+static int mult_fast_scratch_words(int na, int nb)
 {
-    return this->mult(other).mod(n);
+    if (na < nb) {
+        int tn = na; na = nb; nb = tn;
+    }
+    if (nb < karatsuba_threshold)
+        return 0;
+    if (na == nb)
+        return mult_scratch_words(na);
+    // the nb-word slices go through a product of 2nb words; the last one
+    // may be shorter
+    int words = mult_scratch_words(nb);
+    if (0 != na % nb && mult_fast_scratch_words(nb, na % nb) > words)
+        words = mult_fast_scratch_words(nb, na % nb);
+    return 2*nb + words;
 }
 
-Bignum Bignum::mod_exp_binary(const Bignum& exp, const Bignum& n)
+// r = a * b for any sizes, r has na + nb words and must not overlap a or b;
+// scratch has mult_fast_scratch_words(na, nb) words
+static void mult_fast_words64(uint64_t* r, const uint64_t* a, int na, const uint64_t* b, int nb,
+                              uint64_t* scratch)
 {
-    Bignum C(1);
-    Bignum M = *this;
-    int k = exp.getTotalBits();
-    if (1 == exp.getBit(k-1))
-        C = M;
-    for (int i = k-2; i >= 0; i--) {
-        C = C.multMod(C, n);
-        if (1 == exp.getBit(i)) {
-            C = C.multMod(M, n);
-        }
+    if (na < nb) {
+        const uint64_t* tp = a; a = b; b = tp;
+        int tn = na; na = nb; nb = tn;
+    }
+    if (nb < karatsuba_threshold) {
+        mult_words64(r, a, na, b, nb);
+        return;
+    }
+    if (na == nb) {
+        mult_karatsuba_words64(r, a, b, na, scratch);
+        return;
+    }
+    // multiply nb-word slices of a by b and add them up
+    uint64_t* prod = scratch;
+    uint64_t* next = prod + 2*nb;
+    memset(r, 0, (na + nb) * sizeof(uint64_t));
+    for (int i = 0; i < na; i += nb) {
+        int len = (na - i < nb) ? na - i : nb;
+        if (len == nb)
+            mult_karatsuba_words64(prod, a + i, b, nb, next);
+        else
+            mult_fast_words64(prod, b, nb, a + i, len, next);
+        add_1_words64(r + i + len + nb, na - i - len, add_words64(r + i, r + i, prod, len + nb));
     }
-    return C;
 }
 
-Bignum Bignum::mod_exp_binary_Blakley_shiftadd(const Bignum& exp, const Bignum& n)
+// the growing per-thread scratch of the products outside the reducers,
+// which hold their own
+static uint64_t* thread_scratch(int words)
 {
-    Bignum C(1);
-    Bignum M = *this;
-    int k = exp.getTotalBits();
-    if (1 == exp.getBit(k-1))
-        C = M;
-    for (int i = k-2; i >= 0; i--) {
-        C = Blakley_shiftadd(C, C, n);
-        if (1 == exp.getBit(i)) {
-            C = Blakley_shiftadd(C, M, n);
-        }
+    static thread_local vector<uint64_t> scratch;
+    if (static_cast<int>(scratch.size()) < words + 1)
+        scratch.resize(words + 1);
+    return &scratch[0];
+}
+
+// t[s .. 2s] = a*b*R^(-1), below 2n, one row a*b[i] and one row m*n per word
+template <AddmulFn addmul>
+static void Montgomery_rows_words64_t(const uint64_t* a, const uint64_t* b,
+                                      const uint64_t* n, uint64_t n_prime, int s, uint64_t* t)
+{
+    memset(t, 0, (2*s + 1) * sizeof(uint64_t));
+    for (int i = 0; i < s; i++) {
+        uint64_t c1 = addmul(t + i, a, s, b[i]);
+        uint64_t m = t[i] * n_prime;
+        uint64_t c2 = addmul(t + i, n, s, m);
+        // t[i+s] holds the previous top carry; fold both row carries into it
+        uint64_t top = t[i+s] + c1;
+        uint64_t carry = (top < c1);
+        t[i+s] = top + c2;
+        carry += (t[i+s] < c2);
+        t[i+s+1] = carry;
     }
-    return C;
 }
 
-Bignum Bignum::mod_exp_mary(const Bignum& exp, const Bignum& n/*modular*/)
+static void Montgomery_rows_words64(const uint64_t* a, const uint64_t* b,
+                                    const uint64_t* n, uint64_t n_prime, int s, uint64_t* t)
 {
-    Bignum M[M_ARY];
-    M[0] = Bignum(1);
-    M[1] = *this;
-    for (int i = 2; i < M_ARY; i++) 
-        M[i] = M[i-1].multMod(M[1], n);
-    int k = exp.getTotalBits();
-    int r = 2;
-    int s = k/r;
-    if ( 0 != k % r )
-        s++;
-    vector<uint32_t> F;
-    decompose_exp(exp, r, F, s);
-    Bignum C = M[ F[s-1] ];
+    word_kernels->mont_rows(a, b, n, n_prime, s, t);
+}
 
-    for (int i = s-2; i >= 0; i--) {
-        for (int j = 0; j < r; j++) 
-            C = C.multMod(C, n);
-        if ( 0 != F[i] ) 
-            C = C.multMod( M[ F[i] ], n );
+// t[s .. 2s] = t*R^(-1) for the product t (2s words), one row m*n per word;
+// the row carries go through one carry word instead of up the whole of t
+template <AddmulFn addmul>
+static void Montgomery_reduce_words64_t(uint64_t* t, const uint64_t* n, uint64_t n_prime, int s)
+{
+    uint64_t carry = 0;
+    for (int i = 0; i < s; i++) {
+        uint64_t c = addmul(t + i, n, s, t[i] * n_prime);
+        uint64_t top = t[i+s] + c;
+        uint64_t next = (top < c);
+        t[i+s] = top + carry;
+        next += (t[i+s] < carry);
+        carry = next;
     }
-    return C;
+    t[2*s] = carry;
 }
 
-Bignum Bignum::mod_exp_mary_Blakley_shiftadd(const Bignum& exp, const Bignum& n)
+static void Montgomery_reduce_words64(uint64_t* t, const uint64_t* n, uint64_t n_prime, int s)
 {
-    Bignum M[M_ARY];
-    M[0] = Bignum(1);
-    M[1] = *this;
-    for (int i = 2; i < M_ARY; i++) 
-        M[i] = M[i-1].multMod(M[1], n);
-    int k = exp.getTotalBits();
-    int r = 2;
-    int s = k/r;
-    if ( 0 != k % r )
-        s++;
-    vector<uint32_t> F;
-    decompose_exp(exp, r, F, s);
-    Bignum C = M[ F[s-1] ];
+    word_kernels->mont_reduce(t, n, n_prime, s);
+}
 
-    for (int i = s-2; i >= 0; i--) {
-        for (int j = 0; j < r; j++) 
-            C = Blakley_shiftadd(C, C, n);
-        if ( 0 != F[i] ) 
-            C = Blakley_shiftadd(C, M[ F[i] ], n);
+// r = t[s .. 2s] mod n; t < 2n, one conditional subtraction brings it below n
+static void Montgomery_final_words64(uint64_t* r, const uint64_t* t, const uint64_t* n, int s)
+{
+    if (t[2*s] != 0 || compare_words64(t + s, n, s) >= 0) {
+        COUNT(OP_RED_SUB);
+        sub_words64(r, t + s, n, s);
     }
-    return C;
+    else
+        memcpy(r, t + s, s * sizeof(uint64_t));
 }
 
+// scratch words of the Montgomery products on s words: 2s+1 for the
+// product and its reduction, then the multiplier's
+static int Montgomery_scratch_words(int s)
+{
+    return 2*s + 1 + mult_scratch_words(s);
+}
 
-// decompose exp into s r-bit words
-void Bignum::decompose_exp(const Bignum& exp, int r, vector<uint32_t>& F, int s)
+// r = a*b*R^(-1) mod n, R = 2^(64*s), a < R, b < n, n odd.
+// Each outer step adds a*b[i] and m*n, m = t[i]*n_prime clears word i, so
+// the result ends up in t[s..2s]. t is scratch of Montgomery_scratch_words(s)
+// words, r may alias a or b, or be t itself (its low half is free by then).
+// From karatsuba_threshold on, a*b is computed first by the fast multiplier
+// and only m*n is added word by word.
+static void Montgomery_mult_words64(uint64_t* r, const uint64_t* a, const uint64_t* b,
+                                    const uint64_t* n, uint64_t n_prime, int s, uint64_t* t)
 {
-    uint32_t temp = (1 << r) - 1;
-    Bignum exp_copy(exp);
-    for (int i = 0; i < s; i++) {
-        F.push_back(exp_copy.num[0] & temp);
-        for (int j = 0; j < r; j++) {
-            exp_copy.shiftR();
-        }
+    if (s >= karatsuba_threshold) {
+        mult_fast_words64(t, a, s, b, s, t + 2*s + 1);
+        Montgomery_reduce_words64(t, n, n_prime, s);
+    }
+    else {
+        Montgomery_rows_words64(a, b, n, n_prime, s, t);
     }
+    Montgomery_final_words64(r, t, n, s);
 }
 
-Bignum Bignum::Blakley_shiftadd(const Bignum& a, const Bignum& b, const Bignum& n)
+// r = a*b mod n with Blakley's interleaved method, one 64-bit word of a per
+// step: x = x*2^64 + a[i]*b, then x -= q*n with the quotient word q estimated
+// from the top words of x and n and refined with the next word of n (Knuth,
+// Algorithm D, steps D3 and D4). b < n, n has s words and its top bit
+// set; x is s+2 and t s+1 words of scratch; r may alias a.
+static void Blakley_mult_words64(uint64_t* r, const uint64_t* a, int na, const uint64_t* b,
+                                 const uint64_t* n, int s, uint64_t* x, uint64_t* t)
 {
-    Bignum R;
-    for (int i = 0; i < K; i++) {
-        R.shiftL();
-        if ( a.getBit(K-1-i) == 1)
-            R = R.add(b);
-        while (compare(R, n) >= 0)
-            R = R.sub2(n);
+    memset(x, 0, (s + 2) * sizeof(uint64_t));
+    for (int i = na-1; i >= 0; i--) {
+        // x < n, x*2^64 + a[i]*b < 2 * 2^64 * n
+        memmove(x + 1, x, s * sizeof(uint64_t));
+        x[0] = 0;
+        uint64_t c = addmul_words64(x, b, s, a[i]);
+        x[s] += c;
+        x[s+1] = (x[s] < c);
+        // below 2^64 * n the quotient fits in one word
+        if (0 != x[s+1] || compare_words64(x + 1, n, s) >= 0) {
+            COUNT(OP_RED_SUB);
+            x[s+1] -= sub_words64(x + 1, x + 1, n, s);
+        }
+        uint64_t q, rhat;
+        bool rhat_big;          // rhat >= 2^64, the D3 test cannot fail
+        if (x[s] >= n[s-1]) {
+            q = ~0ULL;
+            rhat = x[s-1] + n[s-1];
+            rhat_big = (rhat < n[s-1]);
+        }
+        else {
+            q = div_words64(x[s], x[s-1], n[s-1]);
+            rhat = x[s-1] - q * n[s-1];
+            rhat_big = false;
+        }
+        // D3: q*n[s-2] > rhat:x[s-2] means q is too large; after at most two
+        // steps it is exact or, rarely, one too large
+        while (s > 1 && !rhat_big) {
+            uint64_t lo, hi = mul_word64(q, n[s-2], &lo);
+            if (hi < rhat || (hi == rhat && lo <= x[s-2]))
+                break;
+            q--;
+            rhat += n[s-1];
+            rhat_big = (rhat < n[s-1]);
+        }
+        mult_words64(t, n, s, &q, 1);
+        uint64_t borrow = sub_words64(x, x, t, s + 1);
+        while (0 != borrow) {   // q was too large, add n back
+            COUNT(OP_ADD_BACK);
+            uint64_t carry = add_words64(x, x, n, s);
+            x[s] += carry;
+            if (0 != carry && 0 == x[s])
+                borrow = 0;
+        }
     }
-    return R;
+    memcpy(r, x, s * sizeof(uint64_t));
 }
 
-/* end of definition of member functions */
+/* constant-time kernels
+ * No branch, early exit or memory address below depends on the value of an
+ * operand, only on the sizes. They are used where the operands are secret.
+ */
 
-/* start of definition of local functions */
+// r[0..n-1] += c over all n words, returns the carry
+static uint64_t add_1_ct_words64(uint64_t* r, int n, uint64_t c)
+{
+    for (int i = 0; i < n; i++) {
+        r[i] += c;
+        c = (r[i] < c);
+    }
+    return c;
+}
 
-double read_timer()
+// r = |a - b|, a has l words, b has h <= l words; returns all ones if a < b
+static uint64_t abs_diff_ct_words64(uint64_t* r, const uint64_t* a, int l, const uint64_t* b, int h)
 {
-    static bool initialized = false;
-    static struct timeval start;
-    struct timeval end;
-    if( !initialized )
-    {
-        gettimeofday( &start, NULL );
-        initialized = true;
+    uint64_t borrow = 0;
+    for (int i = 0; i < l; i++) {
+        uint64_t bi = (i < h) ? b[i] : 0;
+        uint64_t diff = a[i] - bi;
+        uint64_t next = (a[i] < bi);
+        next += (diff < borrow);
+        r[i] = diff - borrow;
+        borrow = next;
     }
+    uint64_t mask = 0 - borrow;
+    uint64_t carry = mask & 1;      // negate under the mask: (r ^ mask) + 1
+    for (int i = 0; i < l; i++) {
+        r[i] = (r[i] ^ mask) + carry;
+        carry = (r[i] < carry);
+    }
+    return mask;
+}
 
-    gettimeofday( &end, NULL );
+// Karatsuba as mult_karatsuba_words64, without Toom-3: the signs of the
+// differences are masks, and the middle term adds z1 or its two's complement
+static void mult_karatsuba_ct_words64(uint64_t* r, const uint64_t* a, const uint64_t* b, int n,
+                                      uint64_t* scratch)
+{
+    if (n < karatsuba_threshold) {
+        mult_words64(r, a, n, b, n);
+        return;
+    }
+    int l = (n + 1) >> 1;
+    int h = n - l;
+    uint64_t* da = scratch;       // |a0 - a1|, l words
+    uint64_t* db = da + l;        // |b0 - b1|, l words
+    uint64_t* z1 = db + l;        // da * db, 2l words
+    uint64_t* mid = z1 + 2*l;     // 2l+1 words
+    uint64_t* next = mid + 2*l + 1;
+    uint64_t sub = ~(abs_diff_ct_words64(da, a, l, a + l, h) ^ abs_diff_ct_words64(db, b, l, b + l, h));
+    mult_karatsuba_ct_words64(r, a, b, l, next);
+    mult_karatsuba_ct_words64(r + 2*l, a + l, b + l, h, next);
+    mult_karatsuba_ct_words64(z1, da, db, l, next);
 
-    return (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+    // mid = z0 + z2 + (z1 ^ sub) + (sub & 1), sub all ones means subtract z1
+    memcpy(mid, r, 2*l * sizeof(uint64_t));
+    mid[2*l] = 0;
+    add_1_ct_words64(mid + 2*h, 2*l + 1 - 2*h, add_words64(mid, mid, r + 2*l, 2*h));
+    uint64_t carry = sub & 1;
+    for (int i = 0; i < 2*l; i++) {
+        uint64_t x = z1[i] ^ sub;
+        uint64_t sum = mid[i] + carry;
+        carry = (sum < carry);
+        mid[i] = sum + x;
+        carry += (mid[i] < x);
+    }
+    mid[2*l] += sub + carry;
+    int m = (2*l + 1 < l + 2*h) ? 2*l + 1 : l + 2*h;
+    add_1_ct_words64(r + l + m, l + 2*h - m, add_words64(r + l, r + l, mid, m));
 }
 
-void test8()
+// Montgomery_final_words64 without the branch, t - n is always computed
+static void Montgomery_final_ct_words64(uint64_t* r, uint64_t* t, const uint64_t* n, int s)
 {
-    srand (time(NULL));
-
-    Bignum M;
-    M.genBignum();
-    printf("  M = "); M.print(); printf("\n");
+    uint64_t borrow = sub_words64(t, t + s, n, s);  // the low half is free now
+    uint64_t keep = 0 - ((borrow ^ 1) | t[2*s]);     // all ones: t >= n, take t - n
+    for (int i = 0; i < s; i++)
+        r[i] = (t[i] & keep) | (t[s+i] & ~keep);
+}
 
-    Bignum exp;
-    exp.genBignum();
-    printf("exp = "); exp.print(); printf("\n");
+// Montgomery product in constant time: the product by Karatsuba from
+// karatsuba_threshold on, the rows otherwise, and the final subtraction is
+// always done and then kept or dropped with a mask
+static void Montgomery_mult_ct_words64(uint64_t* r, const uint64_t* a, const uint64_t* b,
+                                       const uint64_t* n, uint64_t n_prime, int s, uint64_t* t)
+{
+    if (s >= karatsuba_threshold) {
+        mult_karatsuba_ct_words64(t, a, b, s, t + 2*s + 1);
+        Montgomery_reduce_words64(t, n, n_prime, s);
+    }
+    else {
+        Montgomery_rows_words64(a, b, n, n_prime, s, t);
+    }
+    Montgomery_final_ct_words64(r, t, n, s);
+}
 
-    Bignum n;
-    n.genBignum();
-    printf("  n = "); n.print(); printf("\n");
+// r = table[index], entries of s words; every entry is read, so the memory
+// access pattern does not depend on index
+static void select_ct_words64(uint64_t* r, const uint64_t* table, int entries, int s, uint64_t index)
+{
+    memset(r, 0, s * sizeof(uint64_t));
+    for (int e = 0; e < entries; e++) {
+        uint64_t diff = static_cast<uint64_t>(e) ^ index;
+        uint64_t mask = ((diff | (0 - diff)) >> 63) - 1;   // all ones iff e == index
+        for (int i = 0; i < s; i++)
+            r[i] |= table[e*s + i] & mask;
+    }
+}
 
-    double seconds;
-    Bignum m1, m2;
+/* squaring kernels
+ * A square needs only the products a[i]*a[j] with i < j (each stands for
+ * two) and the n squares a[i]^2, about half the word products of mult, and
+ * its Karatsuba step needs only squares: a^2 = z0 + (z0 + z2 - z1)*B + z2*B^2
+ * with z1 = (a0 - a1)^2 >= 0, so the middle term never changes sign. Apart
+ * from the Toom-3 case of sqr_fast_words64 they are constant time.
+ */
 
-    printf("Basic implementation. \n");
-    printf("           exponentiation - binary method\n");
-    printf("           multiplication - standard multiplication...\n\n");
+// r = a^2, a has n words, r has 2n words
+template <AddmulFn addmul>
+static void sqr_words64_t(uint64_t* r, const uint64_t* a, int n)
+{
+    // off-diagonal products a[i]*a[j], i < j
+    memset(r, 0, 2*n * sizeof(uint64_t));
+    for (int i = 0; i < n-1; i++)
+        r[i + n] = addmul(r + 2*i + 1, a + i + 1, n - i - 1, a[i]);
+    // doubled
+    uint64_t top = 0;
+    for (int i = 0; i < 2*n; i++) {
+        uint64_t x = r[i];
+        r[i] = (x << 1) | top;
+        top = x >> 63;
+    }
+    // plus the diagonal, a[i]^2 into words 2i and 2i+1
+    uint64_t carry = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t lo, hi = mul_word64(a[i], a[i], &lo);
+        uint64_t x = r[2*i] + carry;
+        uint64_t c = (x < carry);
+        r[2*i] = x + lo;
+        c += (r[2*i] < lo);
+        hi += c;                // c <= 1 and hi <= 2^64 - 2, no wrap
+        r[2*i + 1] += hi;
+        carry = (r[2*i + 1] < hi);
+    }
+}
+
+static void sqr_words64(uint64_t* r, const uint64_t* a, int n)
+{
+    word_kernels->sqr(r, a, n);
+}
+
+// r = a^2 with Karatsuba, a has n words, r has 2n words
+static void sqr_karatsuba_words64(uint64_t* r, const uint64_t* a, int n, uint64_t* scratch)
+{
+    if (n < karatsuba_threshold) {
+        sqr_words64(r, a, n);
+        return;
+    }
+    int l = (n + 1) >> 1;
+    int h = n - l;
+    uint64_t* da = scratch;       // |a0 - a1|, l words
+    uint64_t* z1 = da + l;        // da^2, 2l words
+    uint64_t* mid = z1 + 2*l;     // 2l+1 words
+    uint64_t* next = mid + 2*l + 1;
+    abs_diff_ct_words64(da, a, l, a + l, h);
+    sqr_karatsuba_words64(r, a, l, next);
+    sqr_karatsuba_words64(r + 2*l, a + l, h, next);
+    sqr_karatsuba_words64(z1, da, l, next);
+
+    // mid = z0 + z2 - z1 = 2*a0*a1
+    memcpy(mid, r, 2*l * sizeof(uint64_t));
+    mid[2*l] = 0;
+    add_1_ct_words64(mid + 2*h, 2*l + 1 - 2*h, add_words64(mid, mid, r + 2*l, 2*h));
+    mid[2*l] -= sub_words64(mid, mid, z1, 2*l);
+    int m = (2*l + 1 < l + 2*h) ? 2*l + 1 : l + 2*h;
+    add_1_ct_words64(r + l + m, l + 2*h - m, add_words64(r + l, r + l, mid, m));
+}
+
+// r = a^2: schoolbook, Karatsuba or Toom-3 depending on the size; scratch
+// has mult_scratch_words(n) words
+static void sqr_fast_words64(uint64_t* r, const uint64_t* a, int n, uint64_t* scratch)
+{
+    if (n < karatsuba_threshold) {
+        sqr_words64(r, a, n);
+        return;
+    }
+    if (n >= toom3_threshold) {
+        mult_toom3_words64(r, a, a, n, scratch);
+        return;
+    }
+    sqr_karatsuba_words64(r, a, n, scratch);
+}
+
+// r = a*a*R^(-1) mod n, as Montgomery_mult_words64: the square first, then
+// the reduction
+static void Montgomery_sqr_words64(uint64_t* r, const uint64_t* a,
+                                   const uint64_t* n, uint64_t n_prime, int s, uint64_t* t)
+{
+    sqr_fast_words64(t, a, s, t + 2*s + 1);
+    Montgomery_reduce_words64(t, n, n_prime, s);
+    Montgomery_final_words64(r, t, n, s);
+}
+
+// the same in constant time, without Toom-3
+static void Montgomery_sqr_ct_words64(uint64_t* r, const uint64_t* a,
+                                      const uint64_t* n, uint64_t n_prime, int s, uint64_t* t)
+{
+    if (s < karatsuba_threshold) {
+        sqr_words64(t, a, s);
+    }
+    else {
+        sqr_karatsuba_words64(t, a, s, t + 2*s + 1);
+    }
+    Montgomery_reduce_words64(t, n, n_prime, s);
+    Montgomery_final_ct_words64(r, t, n, s);
+}
+
+/* end of definition of 64-bit word kernels */
+
+/* start of definition of multi-lane Montgomery kernels
+ * A lane vector holds `lanes` independent numbers of m limbs each, limb i of
+ * lane l at x[i*lanes + l], so one vector instruction works on limb i of
+ * every lane. Limbs are radix 2^radix, well below 64 bits, so the carries
+ * can pile up in the spare high bits and are propagated only now and then.
+ *   AVX-512 IFMA: 8 lanes, radix 2^52, VPMADD52LUQ/VPMADD52HUQ
+ *   AVX2:         4 lanes, radix 2^29, VPMULUDQ (32x32->64)
+ *   otherwise:    4 lanes, radix 2^29, the AVX2 algorithm in plain C
+ * The vector kernels are built with target attributes and used only when
+ * CPUID reports the instructions (select_kernels).
+ * lanes_mont_mult(r, a, b, n, n_prime, m, t) sets r = a*b*R^(-1) mod n in
+ * every lane, R = 2^(radix*m). With R > 4n and a, b < 2n the result is below
+ * 2n, so there is no final subtraction. Inputs and output have every limb
+ * below 2^radix; t is (m+1)*lanes words of scratch; r may alias a or b.
+ */
+
+#define LANES_RADIX29   29
+#define LANES_NORMALIZE 16  // 29-bit limbs: carries are propagated every 16 steps
+
+// t = t + carries, every limb below 2^radix, m+1 limbs
+static void lanes_normalize_scalar(uint64_t* t, int m, int lanes, int radix)
+{
+    uint64_t mask = (1ULL << radix) - 1;
+    for (int j = 0; j < m; j++) {
+        for (int l = 0; l < lanes; l++) {
+            t[(j+1)*lanes + l] += t[j*lanes + l] >> radix;
+            t[j*lanes + l] &= mask;
+        }
+    }
+}
+
+// 4 lanes, 29-bit limbs: a limb gets two products below 2^58 per step and
+// is normalized every 16 steps, so it stays below 2^64
+static void lanes_mont_mult_scalar(uint64_t* r, const uint64_t* a, const uint64_t* b,
+                                   const uint64_t* n, const uint64_t* n_prime, int m, uint64_t* t)
+{
+    const int L = 4;
+    const uint64_t mask = (1ULL << LANES_RADIX29) - 1;
+    memset(t, 0, (m+1) * L * sizeof(uint64_t));
+    for (int i = 0; i < m; i++) {
+        for (int l = 0; l < L; l++) {
+            uint64_t ai = a[i*L + l];
+            uint64_t t0 = t[l] + ai * b[l];
+            uint64_t q = ((t0 & mask) * n_prime[l]) & mask;
+            t0 += q * n[l];
+            // t = (t + ai*b + q*n) / 2^29, one limb down
+            uint64_t carry = t0 >> LANES_RADIX29;
+            for (int j = 1; j < m; j++) {
+                t[(j-1)*L + l] = t[j*L + l] + ai * b[j*L + l] + q * n[j*L + l] + carry;
+                carry = 0;
+            }
+            t[(m-1)*L + l] = carry;
+        }
+        if (LANES_NORMALIZE - 1 == i % LANES_NORMALIZE)
+            lanes_normalize_scalar(t, m, L, LANES_RADIX29);
+    }
+    lanes_normalize_scalar(t, m, L, LANES_RADIX29);
+    memcpy(r, t, m * L * sizeof(uint64_t));
+}
+
+#ifdef KERNEL_DISPATCH
+// the same steps as lanes_mont_mult_scalar, one lane per 64-bit element
+__attribute__((target("avx2")))
+static void lanes_mont_mult_avx2(uint64_t* r, const uint64_t* a, const uint64_t* b,
+                                 const uint64_t* n, const uint64_t* n_prime, int m, uint64_t* t)
+{
+    const __m256i mask = _mm256_set1_epi64x((1LL << LANES_RADIX29) - 1);
+    const __m256i np = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(n_prime));
+    __m256i* T = reinterpret_cast<__m256i*>(t);
+    const __m256i* B = reinterpret_cast<const __m256i*>(b);
+    const __m256i* N = reinterpret_cast<const __m256i*>(n);
+    for (int j = 0; j <= m; j++)
+        _mm256_storeu_si256(T + j, _mm256_setzero_si256());
+    for (int i = 0; i < m; i++) {
+        __m256i ai = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a) + i);
+        __m256i t0 = _mm256_add_epi64(_mm256_loadu_si256(T), _mm256_mul_epu32(ai, _mm256_loadu_si256(B)));
+        __m256i q = _mm256_and_si256(_mm256_mul_epu32(_mm256_and_si256(t0, mask), np), mask);
+        t0 = _mm256_add_epi64(t0, _mm256_mul_epu32(q, _mm256_loadu_si256(N)));
+        __m256i carry = _mm256_srli_epi64(t0, LANES_RADIX29);
+        for (int j = 1; j < m; j++) {
+            __m256i tj = _mm256_add_epi64(_mm256_loadu_si256(T + j),
+                                          _mm256_mul_epu32(ai, _mm256_loadu_si256(B + j)));
+            tj = _mm256_add_epi64(tj, _mm256_mul_epu32(q, _mm256_loadu_si256(N + j)));
+            if (1 == j)
+                tj = _mm256_add_epi64(tj, carry);
+            _mm256_storeu_si256(T + j-1, tj);
+        }
+        if (1 == m)
+            _mm256_storeu_si256(T, carry);
+        else
+            _mm256_storeu_si256(T + m-1, _mm256_setzero_si256());
+        if (LANES_NORMALIZE - 1 == i % LANES_NORMALIZE)
+            lanes_normalize_scalar(t, m, 4, LANES_RADIX29);
+    }
+    lanes_normalize_scalar(t, m, 4, LANES_RADIX29);
+    memcpy(r, t, m * 4 * sizeof(uint64_t));
+}
+#endif
+
+#ifdef KERNEL_DISPATCH
+// 8 lanes, 52-bit limbs: the low 52 bits of a product go to limb j and the
+// high 52 bits to limb j+1, a limb gets at most four of them per step, so
+// up to 2^10 steps (52*1024 bits) need no normalization before the end
+__attribute__((target("avx512f,avx512ifma")))
+static void lanes_mont_mult_ifma(uint64_t* r, const uint64_t* a, const uint64_t* b,
+                                 const uint64_t* n, const uint64_t* n_prime, int m, uint64_t* t)
+{
+    const __m512i mask = _mm512_set1_epi64((1LL << 52) - 1);
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i np = _mm512_loadu_si512(n_prime);
+    __m512i* T = reinterpret_cast<__m512i*>(t);
+    const __m512i* B = reinterpret_cast<const __m512i*>(b);
+    const __m512i* N = reinterpret_cast<const __m512i*>(n);
+    for (int j = 0; j <= m; j++)
+        _mm512_storeu_si512(T + j, zero);
+    for (int i = 0; i < m; i++) {
+        __m512i ai = _mm512_loadu_si512(reinterpret_cast<const __m512i*>(a) + i);
+        for (int j = 0; j < m; j++) {
+            __m512i bj = _mm512_loadu_si512(B + j);
+            _mm512_storeu_si512(T + j, _mm512_madd52lo_epu64(_mm512_loadu_si512(T + j), ai, bj));
+            _mm512_storeu_si512(T + j+1, _mm512_madd52hi_epu64(_mm512_loadu_si512(T + j+1), ai, bj));
+        }
+        __m512i t0 = _mm512_loadu_si512(T);
+        __m512i q = _mm512_and_si512(_mm512_madd52lo_epu64(zero, t0, np), mask);
+        t0 = _mm512_madd52lo_epu64(t0, q, _mm512_loadu_si512(N));
+        // the masked form with zero as the source: the plain one passes an
+        // undefined vector, which g++ reports as maybe uninitialized
+        __m512i carry = _mm512_mask_srli_epi64(zero, 0xff, t0, 52);
+        __m512i hi = _mm512_madd52hi_epu64(zero, q, _mm512_loadu_si512(N));
+        // t = (t + q*n) / 2^52, one limb down
+        for (int j = 1; j < m; j++) {
+            __m512i nj = _mm512_loadu_si512(N + j);
+            __m512i tj = _mm512_madd52lo_epu64(_mm512_add_epi64(_mm512_loadu_si512(T + j), hi), q, nj);
+            hi = _mm512_madd52hi_epu64(zero, q, nj);
+            if (1 == j)
+                tj = _mm512_add_epi64(tj, carry);
+            _mm512_storeu_si512(T + j-1, tj);
+        }
+        __m512i top = _mm512_add_epi64(_mm512_loadu_si512(T + m), hi);
+        if (1 == m)
+            top = _mm512_add_epi64(top, carry);
+        _mm512_storeu_si512(T + m-1, top);
+        _mm512_storeu_si512(T + m, zero);
+    }
+    lanes_normalize_scalar(t, m, 8, 52);
+    memcpy(r, t, m * 8 * sizeof(uint64_t));
+}
+#endif
+
+struct LaneEngine {
+    const char* name;
+    int lanes;
+    int radix;
+    void (*mont_mult)(uint64_t* r, const uint64_t* a, const uint64_t* b,
+                      const uint64_t* n, const uint64_t* n_prime, int m, uint64_t* t);
+};
+
+static const LaneEngine* lane_engine;
+
+/* end of definition of multi-lane Montgomery kernels */
+
+/* start of definition of kernel dispatch
+ * CPUID is read once, at startup; select_kernels binds word_kernels and
+ * lane_engine to the fastest kernels the CPU has, or to the ones named on
+ * the command line (-K), to compare them on one machine.
+ */
+
+static const WordKernels word_kernels_generic = {
+    "generic", addmul_generic_words64,
+    mult_words64_t<addmul_generic_words64>, sqr_words64_t<addmul_generic_words64>,
+    Montgomery_rows_words64_t<addmul_generic_words64>, Montgomery_reduce_words64_t<addmul_generic_words64>
+};
+#ifdef KERNEL_DISPATCH
+static const WordKernels word_kernels_adx = {
+    "adx", addmul_adx_words64,
+    mult_words64_t<addmul_adx_words64>, sqr_words64_t<addmul_adx_words64>,
+    Montgomery_rows_words64_t<addmul_adx_words64>, Montgomery_reduce_words64_t<addmul_adx_words64>
+};
+#endif
+
+static const LaneEngine lane_engine_scalar = { "scalar", 4, LANES_RADIX29, lanes_mont_mult_scalar };
+#ifdef KERNEL_DISPATCH
+static const LaneEngine lane_engine_avx2 = { "avx2", 4, LANES_RADIX29, lanes_mont_mult_avx2 };
+static const LaneEngine lane_engine_ifma = { "ifma", 8, 52, lanes_mont_mult_ifma };
+#endif
+
+struct CpuFeatures {
+    bool bmi2, adx, avx2, avx512f, avx512ifma;
+};
+
+static CpuFeatures cpu_features()
+{
+    CpuFeatures f = { false, false, false, false, false };
+#ifdef KERNEL_DISPATCH
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, NULL) < 7 || !__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return f;
+    // the OS must save the YMM (XCR0 bits 1, 2) and ZMM (bits 5, 6, 7) state
+    uint64_t xcr0 = 0;
+    if (0 != (ecx & bit_OSXSAVE)) {
+        uint32_t lo, hi;
+        __asm__ ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+        xcr0 = (static_cast<uint64_t>(hi) << 32) | lo;
+    }
+    bool ymm = (0x6 == (xcr0 & 0x6));
+    bool zmm = ymm && (0xe0 == (xcr0 & 0xe0));
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    f.bmi2 = (0 != (ebx & bit_BMI2));
+    f.adx = (0 != (ebx & (1u << 19)));
+    f.avx2 = ymm && (0 != (ebx & bit_AVX2));
+    f.avx512f = zmm && (0 != (ebx & bit_AVX512F));
+    f.avx512ifma = f.avx512f && (0 != (ebx & (1u << 21)));
+#endif
+    return f;
+}
+
+// the fastest kernels of this CPU, then the ones named in force (NULL, or
+// a comma separated list of generic, adx, scalar, avx2, ifma); false if a
+// named kernel is unknown or not supported here
+static bool select_kernels(const char* force)
+{
+    CpuFeatures f = cpu_features();
+    word_kernels = &word_kernels_generic;
+    lane_engine = &lane_engine_scalar;
+#ifdef KERNEL_DISPATCH
+    if (f.bmi2 && f.adx)
+        word_kernels = &word_kernels_adx;
+    if (f.avx512ifma)
+        lane_engine = &lane_engine_ifma;
+    else if (f.avx2)
+        lane_engine = &lane_engine_avx2;
+#endif
+    if (NULL == force)
+        return true;
+    string names(force);
+    size_t start = 0;
+    while (start <= names.size()) {
+        size_t end = names.find(',', start);
+        if (string::npos == end)
+            end = names.size();
+        string name = names.substr(start, end - start);
+        start = end + 1;
+        if ("generic" == name)
+            word_kernels = &word_kernels_generic;
+        else if ("scalar" == name)
+            lane_engine = &lane_engine_scalar;
+#ifdef KERNEL_DISPATCH
+        else if ("adx" == name && f.bmi2 && f.adx)
+            word_kernels = &word_kernels_adx;
+        else if ("avx2" == name && f.avx2)
+            lane_engine = &lane_engine_avx2;
+        else if ("ifma" == name && f.avx512ifma)
+            lane_engine = &lane_engine_ifma;
+#endif
+        else {
+            printf("kernel %s is unknown or not supported by this CPU\n", name.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+/* end of definition of kernel dispatch */
+
+class Bignum {
+    // 256 bits requires 8 elements, and 64 bits requires 2 elements.
+    uint32_t num[LEN]; // little endian, only num[0 .. size-1] is valid
+    int size;          // number of significant words, num[size-1] != 0
+public:
+    static uint32_t rand_uint32(uint32_t min, uint32_t max);
+    static int compare(const Bignum& b1, const Bignum& b2);
+    static Bignum Blakley_shiftadd(const Bignum& a, const Bignum& b, const Bignum& n);
+    static uint64_t Montgomery_nprime(const Bignum& n);
+    static Bignum Montgomery_R2(const Bignum& n);
+    static Bignum Montgomery_mult(const Bignum& a, const Bignum& b, const Bignum& n, uint64_t n_prime);
+public:
+    Bignum();
+    ~Bignum() {}
+    Bignum(uint32_t value);
+    Bignum(const Bignum& other);
+    Bignum& operator=(const Bignum& other);
+    void print() const;
+    int getBit(int bit) const;
+    uint32_t getBits(int bit, int width) const;
+    int getTotalBits() const;
+    int getSize() const { return size; }
+    void toWords64(uint64_t* w, int words) const;
+    void fromWords64(const uint64_t* w, int words);
+    void fromHex(const char* hex);
+    bool fromHex(const char* hex, int len);
+    int toHex(char* buf, int len) const;
+    bool fromBytes(const unsigned char* bytes, int len);
+    bool toBytes(unsigned char* bytes, int len) const;
+    bool fromDecimal(const char* dec, int len);
+    int toDecimal(char* buf, int len) const;
+    void genBignum(int bits);
+    Bignum add(const Bignum& other) const;
+    Bignum sub2(const Bignum& other) const; // num should be bigger than other.num
+    Bignum mult(const Bignum& other) const;
+    Bignum square() const;
+    // in place, or into r (which may be *this or an operand): no Bignum is
+    // returned by value
+    void addTo(const Bignum& other);                        // *this += other
+    void subFrom(const Bignum& other);                      // *this -= other, *this >= other
+    void mulInto(const Bignum& other, Bignum& r) const;     // r = *this * other
+    void squareInto(Bignum& r) const;                       // r = *this * *this
+    void reduceInto(const Bignum& modular, Bignum& r) const;    // r = *this mod modular
+    void shiftR();
+    void shiftL();
+    void block_shiftL(int block);
+    void normalize();
+    Bignum mod(const Bignum& modular) const;
+    uint32_t mod_word(uint32_t d) const;
+    Bignum divmod(const Bignum& divisor, Bignum& remainder) const;
+private:
+    void divide(const Bignum& divisor, Bignum* quotient, Bignum& remainder) const;
+public:
+    Bignum multMod(const Bignum& other, const Bignum& n) const;
+    Bignum gcd(const Bignum& other) const;
+    Bignum gcd_ext(const Bignum& n, Bignum& u) const;
+    bool mod_inverse(const Bignum& n, Bignum& inverse) const;
+    Bignum mod_exp_binary(const Bignum& exp, const Bignum& n) const;
+    Bignum mod_exp_binary_Blakley_shiftadd(const Bignum& exp, const Bignum& n) const;
+    Bignum mod_exp_mary(const Bignum& exp, const Bignum& n) const;
+    Bignum mod_exp_mary_Blakley_shiftadd(const Bignum& exp, const Bignum& n) const;
+    Bignum mod_exp_binary_Montgomery(const Bignum& exp, const Bignum& n) const;
+    Bignum mod_exp_mary_Montgomery(const Bignum& exp, const Bignum& n) const;
+    Bignum mod_exp_binary_Barrett(const Bignum& exp, const Bignum& n) const;
+    Bignum mod_exp_mary_Barrett(const Bignum& exp, const Bignum& n) const;
+    Bignum mod_exp_sliding(const Bignum& exp, const Bignum& n) const;
+    Bignum mod_exp_sliding_Montgomery(const Bignum& exp, const Bignum& n) const;
+    Bignum mod_exp_sliding_Barrett(const Bignum& exp, const Bignum& n) const;
+    Bignum mod_exp_sliding_fixed(const Bignum& exp, const Bignum& n) const;
+    bool mod_exp_fixed_window_ct(const Bignum& exp, const Bignum& n, Bignum& result) const;
+    template <uint64_t E> Bignum mod_exp_const(const Bignum& n) const;
+    bool RSA_private_CRT(const Bignum& p, const Bignum& q, const Bignum& dP,
+                         const Bignum& dQ, const Bignum& qInv, Bignum& m) const;
+    static int sliding_window_width(int k);
+    static Bignum mod_exp_multi(const Bignum* base, const Bignum* exp, int count, const Bignum& n);
+    static void decompose_exp(const Bignum& exp, int r, vector<uint32_t>& F, int s);
+};
+
+/* start of definition of reducers
+ * A reducer multiplies modulo one fixed n in its own representation Elem.
+ *   enter(r, x)    r = x mod n, in the reducer's domain
+ *   leave(r, x)    r = the residue x stands for
+ *   one(r)         r = 1 in the domain
+ *   mult(r, a, b)  r = a*b mod n, r may alias a or b
+ *   sqr(r, a)      r = a*a mod n, r may alias a
+ * The exponentiation loops (exp_binary, exp_mary, exp_sliding) are written
+ * once over it.
+ */
+
+// standard multiplication followed by Bignum::mod, in place
+class PlainReducer {
+    Bignum n;
+    Bignum t;                   // the product before the reduction
+public:
+    typedef Bignum Elem;
+    PlainReducer(const Bignum& modular) : n(modular) {}
+    void enter(Elem& r, const Bignum& x)
+    {
+        if (Bignum::compare(x, n) >= 0)
+            x.reduceInto(n, r);
+        else
+            r = x;
+    }
+    void leave(Bignum& r, const Elem& x) { r = x; }
+    void one(Elem& r) { enter(r, Bignum(1)); }     // 1 mod n, 0 for n = 1
+    void mult(Elem& r, const Elem& a, const Elem& b)
+    {
+        COUNT(OP_RED_MULT);
+        a.mulInto(b, t);
+        t.reduceInto(n, r);
+    }
+    void sqr(Elem& r, const Elem& a)
+    {
+        COUNT(OP_RED_SQR);
+        a.squareInto(t);
+        t.reduceInto(n, r);
+    }
+};
+
+// Blakley's interleaved shift-add, a 64-bit word of a per step. The kernel
+// needs the top bit of n set, so it works on n << shift and b << shift, and
+// the result, 2^shift * (a*b mod n), is shifted back.
+class BlakleyReducer {
+    int s;                      // 64-bit words of n
+    int shift;
+    Bignum n;
+    vector<uint64_t> N, B, x, t;
+    void product(vector<uint64_t>& r, const vector<uint64_t>& a, const vector<uint64_t>& b);
+public:
+    typedef vector<uint64_t> Elem;
+    BlakleyReducer(const Bignum& modular);
+    void enter(Elem& r, const Bignum& x);
+    void leave(Bignum& r, const Elem& x) { r.fromWords64(&x[0], s); }
+    void one(Elem& r) { enter(r, Bignum(1)); }
+    void mult(Elem& r, const Elem& a, const Elem& b) { COUNT(OP_RED_MULT); product(r, a, b); }
+    // shift-add has no use for a == b, it is counted as a squaring all the same
+    void sqr(Elem& r, const Elem& a) { COUNT(OP_RED_SQR); product(r, a, a); }
+};
+
+// Montgomery product on 64-bit words, Elem is x*R mod n; n must be odd
+class MontgomeryReducer {
+    int s;                      // 64-bit words of n
+    uint64_t n_prime;
+    Bignum n;
+    vector<uint64_t> N, R2, R1, unit, t;     // t: Montgomery_scratch_words(s)
+public:
+    typedef vector<uint64_t> Elem;
+    MontgomeryReducer(const Bignum& modular);
+    void enter(Elem& r, const Bignum& x);
+    void leave(Bignum& r, const Elem& x);
+    void plain(Elem& r, const Bignum& x);   // x mod n, outside the domain
+    void one(Elem& r) { r = R1; }
+    void mult(Elem& r, const Elem& a, const Elem& b)
+    {
+        COUNT(OP_RED_MULT);
+        r.resize(s);
+        Montgomery_mult_words64(&r[0], &a[0], &b[0], &N[0], n_prime, s, &t[0]);
+    }
+    void sqr(Elem& r, const Elem& a)
+    {
+        COUNT(OP_RED_SQR);
+        r.resize(s);
+        Montgomery_sqr_words64(&r[0], &a[0], &N[0], n_prime, s, &t[0]);
+    }
+    // the same in constant time, for secret operands
+    int words() const { return s; }
+    void mult_ct(uint64_t* r, const uint64_t* a, const uint64_t* b)
+    {
+        COUNT(OP_RED_MULT);
+        Montgomery_mult_ct_words64(r, a, b, &N[0], n_prime, s, &t[0]);
+    }
+    void sqr_ct(uint64_t* r, const uint64_t* a)
+    {
+        COUNT(OP_RED_SQR);
+        Montgomery_sqr_ct_words64(r, a, &N[0], n_prime, s, &t[0]);
+    }
+    void leave_ct(Bignum& r, const Elem& x);
+};
+
+#ifdef KERNEL_DISPATCH
+// the ADX row for fixed_bignum.h, in place of its portable FixedRow
+struct FixedRowAdx {
+    template <int N>
+    static uint64_t addmul_fixed(uint64_t* r, const uint64_t* a, uint64_t b)
+    {
+        return addmul_adx_words64(r, a, N, b);
+    }
+    static uint64_t addmul(uint64_t* r, const uint64_t* a, int n, uint64_t b)
+    {
+        return addmul_adx_words64(r, a, n, b);
+    }
+};
+#endif
+
+// Montgomery product with the width Bits fixed at compile time
+// (fixed_bignum.h), for an odd n of exactly Bits/64 64-bit words
+template <int Bits, class Row = FixedRow>
+class FixedMontgomeryReducer {
+    enum { WORDS = FixedBignum<Bits>::WORDS };
+    Bignum n;
+    FixedMontgomery<Bits, Row> mont;
+public:
+    typedef FixedBignum<Bits> Elem;
+    FixedMontgomeryReducer(const Bignum& modular) : n(modular), mont(words(modular).w) {}
+    static Elem words(const Bignum& x)
+    {
+        Elem r;
+        x.toWords64(r.w, WORDS);
+        return r;
+    }
+    void enter(Elem& r, const Bignum& x)
+    {
+        // the Montgomery product needs x below R
+        r = words((x.getSize() > 2*WORDS) ? x.mod(n) : x);
+        mont.to_mont(r.w, r.w);
+    }
+    void leave(Bignum& r, const Elem& x)
+    {
+        Elem y;
+        mont.from_mont(y.w, x.w);
+        r.fromWords64(y.w, WORDS);
+    }
+    void one(Elem& r) { mont.one(r.w); }
+    void mult(Elem& r, const Elem& a, const Elem& b) { COUNT(OP_RED_MULT); mont.mult(r.w, a.w, b.w); }
+    void sqr(Elem& r, const Elem& a) { COUNT(OP_RED_SQR); mont.sqr(r.w, a.w); }
+};
+
+// Barrett reduction on 64-bit words with mu = floor(b^(2s) / n), b = 2^64.
+// A reduction is one product q1*mu for the quotient estimate and one
+// low-half product q3*n, then at most a few subtractions of n.
+class BarrettReducer {
+    int s;                      // 64-bit words of n
+    Bignum n;
+    vector<uint64_t> N, mu, x, q2, r2, scratch;
+    void reduce(uint64_t* r);   // r = x mod n
+public:
+    typedef vector<uint64_t> Elem;
+    BarrettReducer(const Bignum& modular);
+    void enter(Elem& r, const Bignum& x);
+    void leave(Bignum& r, const Elem& x) { r.fromWords64(&x[0], s); }
+    void one(Elem& r) { enter(r, Bignum(1)); }
+    void mult(Elem& r, const Elem& a, const Elem& b)
+    {
+        COUNT(OP_RED_MULT);
+        r.resize(s);
+        mult_fast_words64(&x[0], &a[0], s, &b[0], s, &scratch[0]);
+        reduce(&r[0]);
+    }
+    void sqr(Elem& r, const Elem& a)
+    {
+        COUNT(OP_RED_SQR);
+        r.resize(s);
+        sqr_fast_words64(&x[0], &a[0], s, &scratch[0]);
+        reduce(&r[0]);
+    }
+};
+
+// binary method, left to right
+template <class Reducer>
+Bignum exp_binary(Reducer& red, const Bignum& base, const Bignum& exp)
+{
+    typename Reducer::Elem C, M;
+    red.enter(M, base);
+    red.one(C);
+    int k = exp.getTotalBits();
+    if (1 == exp.getBit(k-1))
+        C = M;
+    for (int i = k-2; i >= 0; i--) {
+        red.sqr(C, C);
+        if (1 == exp.getBit(i)) {
+            red.mult(C, C, M);
+        }
+    }
+    Bignum result;
+    red.leave(result, C);
+    return result;
+}
+
+// m-ary method with the table M[i] = base^i
+template <class Reducer>
+Bignum exp_mary(Reducer& red, const Bignum& base, const Bignum& exp)
+{
+    vector<typename Reducer::Elem> M(M_ARY);
+    red.one(M[0]);
+    red.enter(M[1], base);
+    for (int i = 2; i < M_ARY; i++)
+        red.mult(M[i], M[i-1], M[1]);
+    int k = exp.getTotalBits();
+    int r = 0;                  // bits per digit, m = 2^r
+    while ((2 << r) <= M_ARY)
+        r++;
+    int s = k/r;
+    if ( 0 != k % r || 0 == s )
+        s++;
+    vector<uint32_t> F;
+    Bignum::decompose_exp(exp, r, F, s);
+    typename Reducer::Elem C = M[ F[s-1] ];
+
+    for (int i = s-2; i >= 0; i--) {
+        for (int j = 0; j < r; j++)
+            red.sqr(C, C);
+        if ( 0 != F[i] )
+            red.mult(C, C, M[ F[i] ]);
+    }
+    Bignum result;
+    red.leave(result, C);
+    return result;
+}
+
+// sliding window method, left to right. Windows start and end with a 1 bit,
+// so only the odd powers T[i] = base^(2i+1) are precomputed, and runs of 0
+// bits between windows cost squarings only.
+template <class Reducer>
+Bignum exp_sliding(Reducer& red, const Bignum& base, const Bignum& exp)
+{
+    int k = exp.getTotalBits();
+    int w = Bignum::sliding_window_width(k);
+    vector<typename Reducer::Elem> T(1 << (w-1));
+    typename Reducer::Elem C, M2;
+    red.enter(T[0], base);
+    if (w > 1) {
+        red.sqr(M2, T[0]);
+        for (size_t i = 1; i < T.size(); i++)
+            red.mult(T[i], T[i-1], M2);
+    }
+
+    red.one(C);
+    bool started = false;
+    int i = k-1;
+    while (i >= 0) {
+        if (0 == exp.getBit(i)) {
+            if (started)
+                red.sqr(C, C);
+            i--;
+            continue;
+        }
+        // the window is bits i..j, at most w bits, ending with a 1 bit
+        int j = (i-w+1 > 0) ? i-w+1 : 0;
+        while (0 == exp.getBit(j))
+            j++;
+        uint32_t value = exp.getBits(j, i-j+1);
+        if (started) {
+            for (int l = j; l <= i; l++)
+                red.sqr(C, C);
+            red.mult(C, C, T[value >> 1]);
+        } else {
+            C = T[value >> 1];
+            started = true;
+        }
+        i = j-1;
+    }
+    Bignum result;
+    red.leave(result, C);
+    return result;
+}
+
+// Fixed-base exponentiation with the Lim-Lee comb. The exponent, at most k
+// bits, is written as an h x a bit matrix (row i holds bits i*a .. i*a+a-1),
+// and the columns are split into v blocks of b = ceil(a/v) columns. Table j
+// holds, for every h-bit u, G[j][u] = prod over the rows i set in u of
+// g^(2^(i*a + j*b)). An exponentiation is then b-1 squarings and at most
+// v*b multiplications, against k-1 squarings for the other methods; the
+// tables cost v*2^h elements and are built once per (g, n).
+template <class Reducer>
+class FixedBaseComb {
+    Reducer red;
+    Bignum g;
+    int h, v, k, a, b;
+    vector< vector<typename Reducer::Elem> > G;
+public:
+    FixedBaseComb(const Bignum& base, const Bignum& n, int max_bits, int teeth, int tables);
+    Bignum pow(const Bignum& exp);
+    size_t table_entries() const { return static_cast<size_t>(v) << h; }
+};
+
+template <class Reducer>
+FixedBaseComb<Reducer>::FixedBaseComb(const Bignum& base, const Bignum& n, int max_bits,
+                                      int teeth, int tables)
+    : red(n), g(base), h(teeth), v(tables), k(max_bits)
+{
+    a = (k + h - 1) / h;
+    b = (a + v - 1) / v;
+    v = (a + b - 1) / b;        // more tables than blocks would stay unused
+    G.assign(v, vector<typename Reducer::Elem>(1 << h));
+
+    // G[j][2^i] = g^(2^(i*a + j*b)), one chain of squarings
+    typename Reducer::Elem P;
+    red.enter(P, base);
+    for (int i = 0; i < h; i++) {
+        for (int j = 0; j < v; j++) {
+            G[j][1 << i] = P;
+            int steps = (j < v-1) ? b : a - (v-1)*b;
+            for (int l = 0; l < steps; l++)
+                red.sqr(P, P);
+        }
+    }
+    for (int j = 0; j < v; j++) {
+        red.one(G[j][0]);
+        for (int u = 3; u < (1 << h); u++) {
+            int top = u & (u-1);    // u without its lowest bit
+            if (0 != top)
+                red.mult(G[j][u], G[j][top], G[j][u ^ top]);
+        }
+    }
+}
+
+template <class Reducer>
+Bignum FixedBaseComb<Reducer>::pow(const Bignum& exp)
+{
+    if (exp.getTotalBits() > k)     // longer than the tables cover
+        return exp_sliding(red, g, exp);
+    typename Reducer::Elem C;
+    red.one(C);
+    bool started = false;
+    for (int t = b-1; t >= 0; t--) {
+        if (started)
+            red.sqr(C, C);
+        for (int j = 0; j < v; j++) {
+            int column = j*b + t;
+            if (column >= a)
+                continue;
+            int u = 0;
+            for (int i = 0; i < h; i++)
+                u |= exp.getBit(i*a + column) << i;
+            if (0 == u)
+                continue;
+            if (started) {
+                red.mult(C, C, G[j][u]);
+            } else {
+                C = G[j][u];
+                started = true;
+            }
+        }
+    }
+    Bignum result;
+    red.leave(result, C);
+    return result;
+}
+
+// Straus' simultaneous multi-exponentiation, prod base[i]^exp[i] for up to
+// MAX_MULTI_EXP bases. All exponents are scanned together in w-bit windows,
+// so the squarings are shared; the joint table holds the 2^(w*count)
+// products prod base[i]^d[i] for all digit combinations, and each window
+// costs w squarings and one multiplication by the entry for its digits.
+template <class Reducer>
+Bignum exp_multi(Reducer& red, const Bignum* base, const Bignum* exp, int count)
+{
+    int k = 0;
+    for (int i = 0; i < count; i++)
+        if (exp[i].getTotalBits() > k)
+            k = exp[i].getTotalBits();
+    int w = Bignum::sliding_window_width(k);
+    if (w * count > MULTI_EXP_TABLE_BITS)
+        w = (MULTI_EXP_TABLE_BITS / count > 0) ? MULTI_EXP_TABLE_BITS / count : 1;
+
+    // T[d], digit i in bits i*w .. i*w+w-1 of d; T[d] = T[d - lowest digit unit] * base
+    vector<typename Reducer::Elem> B(count), T(1 << (w*count));
+    for (int i = 0; i < count; i++)
+        red.enter(B[i], base[i]);
+    red.one(T[0]);
+    for (int d = 1; d < (1 << (w*count)); d++) {
+        int i = 0;
+        while (0 == ((d >> (i*w)) & ((1 << w) - 1)))
+            i++;
+        int rest = d - (1 << (i*w));
+        if (0 == rest)
+            T[d] = B[i];
+        else
+            red.mult(T[d], T[rest], B[i]);
+    }
+
+    typename Reducer::Elem C;
+    red.one(C);
+    bool started = false;
+    for (int j = (k + w - 1) / w - 1; j >= 0; j--) {
+        if (started) {
+            for (int l = 0; l < w; l++)
+                red.sqr(C, C);
+        }
+        int d = 0;
+        for (int i = 0; i < count; i++)
+            d |= exp[i].getBits(j*w, w) << (i*w);
+        if (0 == d)
+            continue;
+        if (started) {
+            red.mult(C, C, T[d]);
+        } else {
+            C = T[d];
+            started = true;
+        }
+    }
+    Bignum result;
+    red.leave(result, C);
+    return result;
+}
+
+// fixed window method in constant time: every window costs w squarings and
+// one multiplication, also for a zero digit (by T[0] = 1), the entry is
+// fetched with a scan of the whole table, and the number of windows depends
+// only on the size of n, so neither the running time nor the memory
+// accesses depend on the exponent bits. Only the base, which is public in
+// RSA and DH, is handled in variable time (enter).
+Bignum exp_fixed_window_ct(MontgomeryReducer& red, const Bignum& base, const Bignum& exp)
+{
+    int s = red.words();
+    int k = 64*s;   // exp has at most 64*s bits (checked by the caller)
+    int w = Bignum::sliding_window_width(k);
+    if (w > CT_MAX_WINDOW)
+        w = CT_MAX_WINDOW;
+    // up to 1024 bits the scan of 32 entries per window costs more than the
+    // multiplications the fifth bit saves
+    if (0 == window_width && k <= 1024 && w > 4)
+        w = 4;
+    int entries = 1 << w;
+
+    vector<uint64_t> T(entries * s), M, C(s), G(s);
+    red.enter(M, base);
+    red.one(C);
+    memcpy(&T[0], &C[0], s * sizeof(uint64_t));
+    memcpy(&T[s], &M[0], s * sizeof(uint64_t));
+    for (int d = 2; d < entries; d++)
+        red.mult_ct(&T[d*s], &T[(d-1)*s], &M[0]);
+
+    int windows = (k + w - 1) / w;
+    select_ct_words64(&C[0], &T[0], entries, s, exp.getBits((windows-1)*w, w));
+    for (int j = windows-2; j >= 0; j--) {
+        for (int l = 0; l < w; l++)
+            red.sqr_ct(&C[0], &C[0]);
+        select_ct_words64(&G[0], &T[0], entries, s, exp.getBits(j*w, w));
+        red.mult_ct(&C[0], &C[0], &G[0]);
+    }
+    Bignum result;
+    red.leave_ct(result, C);
+    return result;
+}
+
+// base^E for an exponent known at compile time. The left-to-right binary
+// chain of E is unrolled by the compiler, with no bit scan or bit test at
+// run time. For E = 2^k + 1 (3, 17, 65537) it is also the shortest addition
+// chain: k squarings and one multiplication.
+template <uint64_t E>
+struct ExpChain {
+    template <class Reducer>
+    static void run(Reducer& red, typename Reducer::Elem& C, const typename Reducer::Elem& M)
+    {
+        ExpChain<E / 2>::run(red, C, M);    // C = M^(E/2)
+        red.sqr(C, C);
+        if (E & 1)
+            red.mult(C, C, M);
+    }
+};
+
+template <>
+struct ExpChain<1> {
+    template <class Reducer>
+    static void run(Reducer&, typename Reducer::Elem& C, const typename Reducer::Elem& M) { C = M; }
+};
+
+template <>
+struct ExpChain<0> {
+    template <class Reducer>
+    static void run(Reducer& red, typename Reducer::Elem& C, const typename Reducer::Elem&) { red.one(C); }
+};
+
+template <uint64_t E, class Reducer>
+Bignum exp_const(Reducer& red, const Bignum& base)
+{
+    typename Reducer::Elem C, M;
+    red.enter(M, base);
+    ExpChain<E>::run(red, C, M);
+    Bignum result;
+    red.leave(result, C);
+    return result;
+}
+
+// this^E mod n, E a compile-time constant such as the public exponent 65537
+template <uint64_t E>
+Bignum Bignum::mod_exp_const(const Bignum& n) const
+{
+    if (0 == n.getBit(0)) {
+        PlainReducer red(n);
+        return exp_const<E>(red, *this);
+    }
+    MontgomeryReducer red(n);
+    if (E < 3 || 0 == (E & 1))
+        return exp_const<E>(red, *this);
+    // for an odd E the last multiplication, by the base outside the domain,
+    // also leaves it: (C*R) * base * R^(-1) = C * base, one product less
+    MontgomeryReducer::Elem C, M, B;
+    red.enter(M, *this);
+    ExpChain<(E & 1) ? E - 1 : E>::run(red, C, M);
+    red.plain(B, *this);
+    red.mult(C, C, B);
+    Bignum result;
+    result.fromWords64(&C[0], red.words());
+    return result;
+}
+
+/* end of definition of reducers */
+
+/* start of definition of member functions */
+
+// only the significant words are ever touched, so nothing is cleared here
+Bignum::Bignum()
+{
+    size = 0;
+}
+
+Bignum::Bignum(uint32_t value)
+{
+    num[0] = value;
+    size = (value != 0) ? 1 : 0;
+}
+
+Bignum::Bignum(const Bignum& other)
+{
+    size = other.size;
+    memcpy(num, other.num, size * sizeof(uint32_t));
+}
+
+Bignum& Bignum::operator=(const Bignum& other)
+{
+    if (this != &other) {
+        size = other.size;
+        memcpy(num, other.num, size * sizeof(uint32_t));
+    }
+    return *this;
+}
+
+// drop leading zero words
+void Bignum::normalize()
+{
+    while (size > 0 && 0 == num[size-1])
+        size--;
+}
+
+// pack into 64-bit words, zero padded to words
+void Bignum::toWords64(uint64_t* w, int words) const
+{
+    int i;
+    for (i = 0; 2*i + 1 < size && i < words; i++)
+        w[i] = static_cast<uint64_t>(num[2*i]) | (static_cast<uint64_t>(num[2*i+1]) << 32);
+    if (2*i < size && i < words) {
+        w[i] = num[2*i];
+        i++;
+    }
+    for (; i < words; i++)
+        w[i] = 0;
+}
+
+void Bignum::fromWords64(const uint64_t* w, int words)
+{
+    if (words > (LEN >> 1))   // a full-capacity product may carry a zero word more
+        words = LEN >> 1;
+    for (int i = 0; i < words; i++) {
+        num[2*i] = static_cast<uint32_t>(w[i]);
+        num[2*i+1] = static_cast<uint32_t>(w[i] >> 32);
+    }
+    size = 2*words;
+    normalize();
+}
+
+/* serialization
+ * Big-endian octet strings, hex and decimal, to and from buffers of the
+ * caller. The bytes are moved a 32-bit word at a time; hex goes through
+ * a table of the two digits of every byte, and the digit values through a
+ * table of all 256 characters. Decimal is cut into 19-digit pieces (10^19
+ * fits a 64-bit word) by divide and conquer: x = q*10^(19*2^k) + r, with
+ * the powers 10^(19*2^k) squared up once per call, so the long divisions
+ * and products are few and large instead of one pass over x per piece.
+ */
+
+#define DEC_PIECE_DIGITS 19
+#define DEC_PIECE        10000000000000000000ULL  // 10^19
+#define MAX_DEC_DIGITS   (MAX_BITS * 30103 / 100000 + 1)  // digits of the largest fromDecimal input
+
+struct DigitTables {
+    char hex_pair[256][2];      // "00" .. "ff"
+    char dec_pair[100][2];      // "00" .. "99"
+    int8_t hex_value[256];      // -1 for a character that is not a hex digit
+    DigitTables()
+    {
+        static const char digits[] = "0123456789abcdef";
+        for (int i = 0; i < 256; i++) {
+            hex_pair[i][0] = digits[i >> 4];
+            hex_pair[i][1] = digits[i & 15];
+            hex_value[i] = -1;
+        }
+        for (int i = 0; i < 100; i++) {
+            dec_pair[i][0] = static_cast<char>('0' + i / 10);
+            dec_pair[i][1] = static_cast<char>('0' + i % 10);
+        }
+        for (int i = 0; i < 16; i++) {
+            hex_value[static_cast<unsigned char>(digits[i])] = static_cast<int8_t>(i);
+            hex_value[static_cast<unsigned char>(toupper(digits[i]))] = static_cast<int8_t>(i);
+        }
+    }
+};
+static const DigitTables digit_tables;
+
+static inline uint32_t load_be32(const unsigned char* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+         | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static inline void store_be32(unsigned char* p, uint32_t v)
+{
+    p[0] = static_cast<unsigned char>(v >> 24);
+    p[1] = static_cast<unsigned char>(v >> 16);
+    p[2] = static_cast<unsigned char>(v >> 8);
+    p[3] = static_cast<unsigned char>(v);
+}
+
+// big endian, leading zero bytes allowed; false if longer than MAX_BITS
+bool Bignum::fromBytes(const unsigned char* bytes, int len)
+{
+    while (len > 0 && 0 == *bytes) {
+        bytes++;
+        len--;
+    }
+    if (len > MAX_BITS / 8)
+        return false;
+    size = (len + 3) >> 2;
+    const unsigned char* p = bytes + len;
+    int i = 0;
+    for (; 4*i + 4 <= len; i++) {
+        p -= 4;
+        num[i] = load_be32(p);
+    }
+    if (i < size) {
+        uint32_t top = 0;
+        for (const unsigned char* b = bytes; b < p; b++)
+            top = (top << 8) | *b;
+        num[i] = top;
+    }
+    normalize();
+    return true;
+}
+
+// exactly len bytes, big endian, zero padded in front; false if x needs more
+bool Bignum::toBytes(unsigned char* bytes, int len) const
+{
+    if ((getTotalBits() + 7) >> 3 > len)
+        return false;
+    unsigned char* p = bytes + len;
+    int i = 0;
+    for (; i < size && p - bytes >= 4; i++) {
+        p -= 4;
+        store_be32(p, num[i]);
+    }
+    for (uint32_t top = (i < size) ? num[i] : 0; p > bytes; top >>= 8)
+        *--p = static_cast<unsigned char>(top);
+    return true;
+}
+
+// exactly len hex digits, either case; false on another character or more
+// than MAX_BITS bits
+bool Bignum::fromHex(const char* hex, int len)
+{
+    while (len > 0 && '0' == *hex) {
+        hex++;
+        len--;
+    }
+    if (len > MAX_BITS / 4)
+        return false;
+    size = (len + 7) >> 3;
+    for (int i = 0; i < size; i++) {
+        // digits len-8i-8 .. len-8i-1 make word i
+        int first = (len - 8*i - 8 > 0) ? len - 8*i - 8 : 0;
+        uint32_t word = 0;
+        for (int j = first; j < len - 8*i; j++) {
+            int v = digit_tables.hex_value[static_cast<unsigned char>(hex[j])];
+            if (v < 0)
+                return false;
+            word = (word << 4) | v;
+        }
+        num[i] = word;
+    }
+    normalize();
+    return true;
+}
+
+// lowercase, no leading zeros, NUL terminated; the digits written, or -1 if
+// they and the NUL do not fit in len chars
+int Bignum::toHex(char* buf, int len) const
+{
+    int digits = (0 == size) ? 1 : (getTotalBits() + 3) >> 2;
+    if (digits + 1 > len)
+        return -1;
+    char* p = buf + digits;
+    *p = '\0';
+    for (int i = 0; i < size; i++) {
+        // the last word may stop inside a byte pair
+        for (int b = 0; b < 4 && p > buf; b++) {
+            const char* pair = digit_tables.hex_pair[(num[i] >> (8*b)) & 0xff];
+            *--p = pair[1];
+            if (p > buf)
+                *--p = pair[0];
+        }
+    }
+    if (0 == size)
+        buf[0] = '0';
+    return digits;
+}
+
+// v < 10^19 into exactly `width` digits ending at end, zero padded in front
+static void dec_piece(char* end, uint64_t v, int width)
+{
+    for (; width >= 2; width -= 2) {
+        end -= 2;
+        memcpy(end, digit_tables.dec_pair[v % 100], 2);
+        v /= 100;
+    }
+    if (width > 0)
+        *--end = static_cast<char>('0' + v);
+}
+
+// x < pow[k+1] into buf: exactly `width` digits, zero padded, or without
+// leading zeros for width 0; returns the digits written
+static int dec_digits(const Bignum& x, const vector<Bignum>& pow, int k, char* buf, int width)
+{
+    if (k < 0) {
+        uint64_t v;
+        x.toWords64(&v, 1);
+        if (0 == width) {
+            width = 1;
+            for (uint64_t t = v; t >= 10; t /= 10)
+                width++;
+        }
+        dec_piece(buf + width, v, width);
+        return width;
+    }
+    if (0 == width && Bignum::compare(x, pow[k]) < 0)
+        return dec_digits(x, pow, k-1, buf, 0);
+    Bignum r;
+    Bignum q = x.divmod(pow[k], r);
+    int half = DEC_PIECE_DIGITS << k;
+    int digits = dec_digits(q, pow, k-1, buf, (0 == width) ? 0 : width - half);
+    return digits + dec_digits(r, pow, k-1, buf + digits, half);
+}
+
+// digits of a number below 2^bits, at most one more than it has:
+// 0.30103 is just above log10(2)
+static int dec_digits_bound(int bits)
+{
+    return bits * 30103 / 100000 + 1;
+}
+
+// pow[k] = 10^(19*2^k) for every k with pow[k] <= x (at least pow[0])
+static void dec_powers(const Bignum& x, vector<Bignum>& pow)
+{
+    pow.assign(1, Bignum());
+    uint64_t piece = DEC_PIECE;
+    pow[0].fromWords64(&piece, 1);
+    while (2*pow.back().getTotalBits() - 1 <= x.getTotalBits())
+        pow.push_back(pow.back().square());
+}
+
+// no leading zeros, NUL terminated, straight into buf; the digits written,
+// or -1 if len is below dec_digits_bound(getTotalBits()) + 1
+int Bignum::toDecimal(char* buf, int len) const
+{
+    if (dec_digits_bound(getTotalBits()) + 1 > len)
+        return -1;
+    vector<Bignum> pow;
+    dec_powers(*this, pow);
+    int n = dec_digits(*this, pow, static_cast<int>(pow.size()) - 1, buf, 0);
+    buf[n] = '\0';
+    return n;
+}
+
+// x = the decimal dec[0 .. len-1], hi*10^(19*2^k) + lo with lo the last
+// 19*2^k digits
+static bool dec_parse(const char* dec, int len, const vector<Bignum>& pow, Bignum& x)
+{
+    if (len <= DEC_PIECE_DIGITS) {
+        uint64_t v = 0;
+        for (int i = 0; i < len; i++) {
+            unsigned digit = static_cast<unsigned char>(dec[i]) - '0';
+            if (digit > 9)
+                return false;
+            v = 10*v + digit;
+        }
+        x.fromWords64(&v, 1);
+        return true;
+    }
+    int k = 0;
+    while (DEC_PIECE_DIGITS << (k+1) < len)
+        k++;
+    int low = DEC_PIECE_DIGITS << k;
+    Bignum hi, lo;
+    if (!dec_parse(dec, len - low, pow, hi) || !dec_parse(dec + len - low, low, pow, lo))
+        return false;
+    hi.mulInto(pow[k], x);
+    x.addTo(lo);
+    return true;
+}
+
+// exactly len decimal digits; false on another character or more than
+// MAX_BITS bits
+bool Bignum::fromDecimal(const char* dec, int len)
+{
+    while (len > 0 && '0' == *dec) {
+        dec++;
+        len--;
+    }
+    if (len > MAX_DEC_DIGITS)
+        return false;
+    // the powers up to the largest split, 10^(19*2^k) < 10^len
+    vector<Bignum> pow(1);
+    uint64_t piece = DEC_PIECE;
+    pow[0].fromWords64(&piece, 1);
+    while (DEC_PIECE_DIGITS << pow.size() < len)
+        pow.push_back(pow.back().square());
+    Bignum x;
+    if (!dec_parse(dec, len, pow, x) || x.getTotalBits() > MAX_BITS)
+        return false;
+    *this = x;
+    return true;
+}
+
+// one write per number: print() is called on every result
+void Bignum::print() const
+{
+    char line[9*LEN + 10];
+    char* p = line;
+    if (0 == size) {
+        memcpy(p, "00000000", 8);
+        p += 8;
+    }
+    for(int i = size - 1; i >= 0; i--) {
+#ifndef SHOW_ZERO
+        if (0 == num[i])
+            continue;
+#endif
+        for (int b = 3; b >= 0; b--) {
+            memcpy(p, digit_tables.hex_pair[(num[i] >> (8*b)) & 0xff], 2);
+            p += 2;
+        }
+#ifndef NO_SPACE
+        *p++ = ' ';
+#endif
+    }
+    *p++ = '\n';
+    fwrite(line, 1, p - line, stdout);
+}
+
+int Bignum::getBit(int bit) const
+{
+    if (bit < 0 || (bit>>5) >= size)
+        return 0;
+    uint32_t segment = num[bit>>5];
+    bit = bit & 31;  //TODO: optimize!!
+    uint32_t temp = 1 << bit;
+    segment = temp & segment;
+    if (temp == segment)        return 1;
+    else                        return 0;
+}
+
+// bits [bit, bit+width) as a number, width <= 32
+uint32_t Bignum::getBits(int bit, int width) const
+{
+    int w = bit >> 5;
+    uint64_t segment = (w < size) ? num[w] : 0;
+    if (w+1 < size)
+        segment |= static_cast<uint64_t>(num[w+1]) << 32;
+    return static_cast<uint32_t>((segment >> (bit & 31)) & ((1ULL << width) - 1));
+}
+
+int Bignum::getTotalBits() const
+{
+    if (0 == size)
+        return 0;
+    int k = size*32 - 1;
+    while (0 == getBit(k))
+        k--;
+    return (k+1);
+}
+
+int Bignum::compare(const Bignum& b1, const Bignum& b2)
+{
+    COUNT(OP_COMPARE);
+    if (b1.size != b2.size)
+        return (b1.size > b2.size) ? 1 : -1;
+    int result = 0;
+    for(int i = b1.size-1; i >= 0; i--) {
+        if ( b1.num[i] > b2.num[i] ) {
+            result = 1;
+            break;
+        }
+        else if (b1.num[i] < b2.num[i]) {
+            result = -1;
+            break;
+        }
+    }
+    return result;
+}
+
+uint32_t Bignum::rand_uint32(uint32_t min, uint32_t max)
+{
+    uint32_t result = 0;
+    if (min > max) {
+        printf("Bignum::gen wrong min and max\n");
+        return result;
+    }
+    uint64_t range = static_cast<uint64_t>(max) - static_cast<uint64_t>(min) + 1;
+    result = (uint32_t) ( ( rand() % range ) + min ); //TODO
+    return result;
+}
+
+// hex digits, most significant first, as print() writes them; spaces are skipped
+void Bignum::fromHex(const char* hex)
+{
+    size = 0;
+    int digits = 0;
+    for (const char* c = hex; *c; c++)
+        if (' ' != *c && '\n' != *c)
+            digits++;
+    for (const char* c = hex; *c; c++) {
+        int value = digit_tables.hex_value[static_cast<unsigned char>(*c)];
+        if (value < 0)
+            continue;
+        digits--;
+        int w = digits >> 3;
+        if (w >= LEN)
+            continue;
+        while (size <= w)
+            num[size++] = 0;
+        num[w] |= static_cast<uint32_t>(value) << ((digits & 7) << 2);
+    }
+    normalize();
+}
+
+// random number of (at most) bits bits
+void Bignum::genBignum(int bits)
+{
+    size = (bits + 31) >> 5;
+    for (int i = 0; i < size; i++) {
+        num[i] = rand_uint32(0, MAX_UINT32);
+    }
+    if (0 != (bits & 31))
+        num[size-1] &= MAX_UINT32 >> (32 - (bits & 31));
+    normalize();
+}
+
+Bignum Bignum::add(const Bignum& other) const
+{
+    Bignum result(*this);
+    result.addTo(other);
+    return result;
+}
+
+void Bignum::addTo(const Bignum& other)
+{
+    COUNT(OP_ADD);
+    int n = (size >= other.size) ? size : other.size;
+    for (int i = size; i < n; i++)
+        num[i] = 0;
+    uint64_t temp;
+    uint64_t carry = 0;
+
+    int i;
+    for (i = 0; i < other.size; i++) {
+        temp = static_cast<uint64_t>(num[i])
+               + static_cast<uint64_t>(other.num[i])
+               + carry;
+        carry = temp >> 32;
+        num[i] = temp & MAX_UINT32;
+    }
+    for (; i < n && 0 != carry; i++) {
+        temp = static_cast<uint64_t>(num[i]) + carry;
+        carry = temp >> 32;
+        num[i] = temp & MAX_UINT32;
+    }
+    size = n;
+    if (0 != carry)
+        num[size++] = static_cast<uint32_t>(carry);
+}
+
+// sub2 will happen only if this->num is bigger than other.num
+Bignum Bignum::sub2(const Bignum& other) const
+{
+    Bignum result(*this);
+    result.subFrom(other);
+    return result;
+}
+
+void Bignum::subFrom(const Bignum& other)
+{
+    COUNT(OP_SUB2);
+    uint64_t carry = 0;
+    for (int i = 0; i < size && (i < other.size || 0 != carry); i++) {
+        uint64_t num_a = static_cast<uint64_t>(num[i]);
+        uint64_t num_b = (i < other.size) ? static_cast<uint64_t>(other.num[i]) : 0;
+        uint64_t temp = num_a - num_b - carry;
+        num[i] = static_cast<uint32_t>(temp);
+        carry = temp >> 63;
+    }
+    normalize();
+}
+
+// result = *this * other, both operands together must fit in LEN words
+Bignum Bignum::mult(const Bignum& other) const
+{
+    Bignum result;
+    mulInto(other, result);
+    return result;
+}
+
+void Bignum::mulInto(const Bignum& other, Bignum& r) const
+{
+    COUNT(OP_MULT);
+    if (0 == size || 0 == other.size) {
+        r.size = 0;
+        return;
+    }
+
+    // on 64-bit words: schoolbook, Karatsuba or Toom-3 depending on the size
+    int na = (size + 1) >> 1;
+    int nb = (other.size + 1) >> 1;
+    uint64_t a[LEN >> 1], b[LEN >> 1], t[(LEN >> 1) + 1];
+    toWords64(a, na);
+    other.toWords64(b, nb);
+    mult_fast_words64(t, a, na, b, nb, thread_scratch(mult_fast_scratch_words(na, nb)));
+    r.fromWords64(t, na + nb);
+}
+
+Bignum Bignum::square() const
+{
+    Bignum result;
+    squareInto(result);
+    return result;
+}
+
+void Bignum::squareInto(Bignum& r) const
+{
+    COUNT(OP_SQUARE);
+    if (0 == size) {
+        r.size = 0;
+        return;
+    }
+    int na = (size + 1) >> 1;
+    uint64_t a[LEN >> 1], t[LEN];
+    toWords64(a, na);
+    sqr_fast_words64(t, a, na, thread_scratch(mult_scratch_words(na)));
+    r.fromWords64(t, 2*na);
+}
+
+void Bignum::shiftR()
+{
+    COUNT(OP_SHIFTR);
+    uint32_t CONSTANT = 0x80000000;
+    uint32_t carry = 0;
+    for (int i = size-1; i >= 0; i--) {
+        uint32_t temp = num[i];
+        num[i] = num[i] >> 1;
+        num[i] += carry;
+        if(temp & 0x1 == 0x1) 
+            carry = CONSTANT;
+        else 
+            carry = 0;
+    }
+    normalize();
+}
+
+void Bignum::shiftL()
+{
+    COUNT(OP_SHIFTL);
+    uint32_t CONSTANT = 0x80000000;
+    uint32_t carry = 0;
+    for (int i = 0; i < size; i++) {
+        uint32_t temp = num[i];
+        num[i] = (num[i] << 1) + carry;
+        temp = temp & CONSTANT;
+        if (temp == CONSTANT) {
+            carry = 1;
+        }
+        else {
+            carry = 0;
+        }
+    }
+    if (0 != carry)
+        num[size++] = carry;
+}
+
+// the Bignum is kbits, wants to shift left by blocks
+void Bignum::block_shiftL(int block)
+{
+    if (0 == size)
+        return;
+    for (int i = size-1; i >= 0; i--) {
+        num[i + block] = num[i];
+    }
+    for (int i = block-1; i >= 0; i--) {
+        num[i] = 0;
+    }
+    size += block;
+}
+
+Bignum Bignum::mod(const Bignum& modular) const
+{
+    Bignum remainder;
+    reduceInto(modular, remainder);
+    return remainder;
+}
+
+// the remainder only, the quotient words are not stored
+void Bignum::reduceInto(const Bignum& modular, Bignum& r) const
+{
+    COUNT(OP_MOD);
+    divide(modular, NULL, r);
+}
+
+// *this mod d for a single word d > 0, one pass from the top word down
+uint32_t Bignum::mod_word(uint32_t d) const
+{
+    uint64_t r = 0;
+    for (int i = size-1; i >= 0; i--)
+        r = ((r << 32) | num[i]) % d;
+    return static_cast<uint32_t>(r);
+}
+
+// quotient = *this / divisor, remainder = *this % divisor.
+// Long division one 32-bit word at a time (Knuth, TAOCP vol. 2, 4.3.1,
+// Algorithm D): the divisor is normalized so its top bit is set, then each
+// quotient word is estimated from the top two words of the remainder and
+// the top word of the divisor, and is at most one too large after the check
+// against the second divisor word.
+Bignum Bignum::divmod(const Bignum& divisor, Bignum& remainder) const
+{
+    COUNT(OP_DIVMOD);
+    Bignum quotient;
+    divide(divisor, &quotient, remainder);
+    return quotient;
+}
+
+// quotient may be NULL; remainder may be *this, but not the quotient
+void Bignum::divide(const Bignum& divisor, Bignum* quotient, Bignum& remainder) const
+{
+    int m = size;
+    int n = divisor.size;
+    if (NULL != quotient)
+        quotient->size = 0;
+    if (0 == n) {
+        printf("Bignum::divmod division by zero\n");
+        remainder.size = 0;
+        return;
+    }
+    if (compare(*this, divisor) < 0) {
+        remainder = *this;
+        return;
+    }
+
+    const uint64_t b = 1ULL << 32;
+    if (1 == n) {
+        uint64_t d = divisor.num[0];
+        uint64_t rem = 0;
+        for (int i = m-1; i >= 0; i--) {
+            uint64_t cur = (rem << 32) | num[i];
+            if (NULL != quotient)
+                quotient->num[i] = static_cast<uint32_t>(cur / d);
+            rem = cur % d;
+        }
+        if (NULL != quotient) {
+            quotient->size = m;
+            quotient->normalize();
+        }
+        remainder.num[0] = static_cast<uint32_t>(rem);
+        remainder.size = (0 != rem) ? 1 : 0;
+        return;
+    }
+
+    // D1: normalize, vn = divisor << shift, un = *this << shift with one more word
+    int shift = 0;
+    while (0 == (divisor.num[n-1] & (0x80000000u >> shift)))
+        shift++;
+    uint32_t vn[LEN];
+    uint32_t un[LEN + 1];
+    for (int i = n-1; i > 0; i--)
+        vn[i] = (divisor.num[i] << shift) | (shift ? divisor.num[i-1] >> (32 - shift) : 0);
+    vn[0] = divisor.num[0] << shift;
+    un[m] = shift ? num[m-1] >> (32 - shift) : 0;
+    for (int i = m-1; i > 0; i--)
+        un[i] = (num[i] << shift) | (shift ? num[i-1] >> (32 - shift) : 0);
+    un[0] = num[0] << shift;
+
+    for (int j = m - n; j >= 0; j--) {
+        // D3: estimate qhat from the top two words
+        uint64_t top = (static_cast<uint64_t>(un[j+n]) << 32) | un[j+n-1];
+        uint64_t qhat = top / vn[n-1];
+        uint64_t rhat = top % vn[n-1];
+        while (qhat >= b || qhat * vn[n-2] > ((rhat << 32) | un[j+n-2])) {
+            qhat--;
+            rhat += vn[n-1];
+            if (rhat >= b)
+                break;
+        }
+
+        // D4: un[j .. j+n] -= qhat * vn
+        uint64_t carry = 0;
+        uint64_t borrow = 0;
+        for (int i = 0; i < n; i++) {
+            uint64_t p = qhat * vn[i] + carry;
+            carry = p >> 32;
+            uint64_t temp = static_cast<uint64_t>(un[i+j]) - (p & MAX_UINT32) - borrow;
+            un[i+j] = static_cast<uint32_t>(temp);
+            borrow = (temp >> 32) & 1;
+        }
+        uint64_t temp = static_cast<uint64_t>(un[j+n]) - carry - borrow;
+        un[j+n] = static_cast<uint32_t>(temp);
+
+        // D5, D6: qhat was one too large, add the divisor back
+        if (temp >> 63) {
+            COUNT(OP_ADD_BACK);
+            qhat--;
+            carry = 0;
+            for (int i = 0; i < n; i++) {
+                temp = static_cast<uint64_t>(un[i+j]) + vn[i] + carry;
+                un[i+j] = static_cast<uint32_t>(temp);
+                carry = temp >> 32;
+            }
+            un[j+n] += static_cast<uint32_t>(carry);
+        }
+        if (NULL != quotient)
+            quotient->num[j] = static_cast<uint32_t>(qhat);
+    }
+    if (NULL != quotient) {
+        quotient->size = m - n + 1;
+        quotient->normalize();
+    }
+
+    // D8: unnormalize the remainder
+    for (int i = 0; i < n; i++)
+        remainder.num[i] = (un[i] >> shift) | (shift ? un[i+1] << (32 - shift) : 0);
+    remainder.size = n;
+    remainder.normalize();
+}
+
+Bignum Bignum::multMod(const Bignum& other, const Bignum& n) const
+{
+    COUNT(OP_MULTMOD);
+    return this->mult(other).mod(n);
+}
+
+/* extended GCD
+ * Lehmer's Euclid (Knuth, TAOCP vol. 2, 4.5.2, Algorithm L): the quotient
+ * sequence of a, b mostly depends on their leading bits only, so it is run
+ * on the top LEHMER_BITS bits of both, in single words, as long as the
+ * quotients are certain. The steps taken are collected in the cofactor
+ * matrix (A B; C D), which is then applied to the full numbers, one pass for
+ * about LEHMER_BITS/2 bits of progress instead of one pass per quotient.
+ * The cofactors of a Euclid sequence alternate in sign, so only their
+ * magnitudes are kept, and those only ever add; the sign follows from the
+ * number of steps.
+ */
+
+#define LEHMER_BITS 62  // leading bits in the single-word steps; the cofactors stay below 2^62
+
+// x >> shift, the low 64 bits, x has n words
+static uint64_t bits_at_words64(const uint64_t* x, int n, int shift)
+{
+    int word = shift >> 6, bit = shift & 63;
+    uint64_t lo = x[word] >> bit;
+    if (0 != bit && word + 1 < n)
+        lo |= x[word + 1] << (64 - bit);
+    return lo;
+}
+
+// r = cx*x - cy*y, n words; the difference must be in [0, 2^(64n)). t is
+// scratch of n+1 words, r has n+1 words.
+static void lincomb_words64(uint64_t* r, const uint64_t* x, uint64_t cx,
+                            const uint64_t* y, uint64_t cy, int n, uint64_t* t)
+{
+    memset(r, 0, n * sizeof(uint64_t));
+    r[n] = addmul_words64(r, x, n, cx);
+    memset(t, 0, n * sizeof(uint64_t));
+    t[n] = addmul_words64(t, y, n, cy);
+    sub_words64(r, r, t, n + 1);
+}
+
+// r = cx*x + cy*y, n words each, r has n+1 words
+static void addcomb_words64(uint64_t* r, const uint64_t* x, uint64_t cx,
+                            const uint64_t* y, uint64_t cy, int n)
+{
+    memset(r, 0, n * sizeof(uint64_t));
+    r[n] = addmul_words64(r, x, n, cx);
+    r[n] += addmul_words64(r, y, n, cy);
+}
+
+// Runs Euclid on a >= b, n words each, until b = 0; a ends up as the gcd.
+// With u0, u1 (m words, zero and one on entry, and m large enough for the
+// original a) it also keeps the cofactor magnitudes |t_i| of
+// r_i = t_i * b mod a, where r_0 = a and r_1 = b; u0 ends up as |t| of the
+// gcd. Returns the index i of the gcd in the remainder sequence, t_i < 0 for
+// even i > 0.
+static int gcd_words64(uint64_t* a, uint64_t* b, int n, uint64_t* u0, uint64_t* u1, int m)
+{
+    vector<uint64_t> ra(n + 1), rb(n + 1), t(n + 2), ua, ub;
+    if (NULL != u0) {
+        ua.resize(m + 1);
+        ub.resize(m + 1);
+    }
+    int steps = 0;
+    while (true) {
+        while (n > 0 && 0 == a[n-1])
+            n--;
+        int nb = n;
+        while (nb > 0 && 0 == b[nb-1])
+            nb--;
+        if (0 == nb)
+            return steps;
+
+        if (1 == n) {
+            // single words: plain Euclid
+            uint64_t x = a[0], y = b[0];
+            while (0 != y) {
+                uint64_t q = x / y, r = x - q*y;
+                x = y;
+                y = r;
+                if (NULL != u0) {
+                    addmul_words64(u0, u1, m, q);   // u0 + q*u1 <= the original a
+                    swap_ranges(u0, u0 + m, u1);
+                }
+                steps++;
+            }
+            a[0] = x;
+            b[0] = 0;
+            return steps;
+        }
+
+        // the top LEHMER_BITS bits of a, and b at the same shift
+        int top = 63;
+        while (0 == (a[n-1] >> top))
+            top--;
+        int shift = 64*(n-1) + top + 1 - LEHMER_BITS;
+        if (shift < 0)
+            shift = 0;
+        int64_t ah = static_cast<int64_t>(bits_at_words64(a, n, shift));
+        int64_t bh = static_cast<int64_t>(bits_at_words64(b, n, shift));
+        int64_t A = 1, B = 0, C = 0, D = 1;
+        int j = 0;
+        while (0 != bh + C && 0 != bh + D) {
+            int64_t q = (ah + A) / (bh + C);
+            if (q != (ah + B) / (bh + D))
+                break;
+            int64_t T = A - q*C;
+            A = C;
+            C = T;
+            T = B - q*D;
+            B = D;
+            D = T;
+            T = ah - q*bh;
+            ah = bh;
+            bh = T;
+            j++;
+        }
+
+        if (0 == j) {
+            // the quotient does not fit in the leading bits: one full division
+            Bignum x, y, q, r;
+            x.fromWords64(a, n);
+            y.fromWords64(b, n);
+            q = x.divmod(y, r);
+            memcpy(a, b, n * sizeof(uint64_t));
+            r.toWords64(b, n);
+            if (NULL != u0) {
+                int nq = (q.getTotalBits() + 63) >> 6;
+                vector<uint64_t> qw(nq), p(nq + m);
+                q.toWords64(&qw[0], nq);
+                mult_words64(&p[0], u1, m, &qw[0], nq);
+                add_words64(u0, u0, &p[0], m);  // the sum is below the original a
+                swap_ranges(u0, u0 + m, u1);
+            }
+            steps++;
+            continue;
+        }
+
+        // (a, b) = (A*a + B*b, C*a + D*b); after an odd number of steps A, D
+        // are <= 0 and B, C > 0, after an even number the other way round
+        uint64_t mA = (A < 0) ? -A : A, mB = (B < 0) ? -B : B;
+        uint64_t mC = (C < 0) ? -C : C, mD = (D < 0) ? -D : D;
+        if (j & 1) {
+            lincomb_words64(&ra[0], b, mB, a, mA, n, &t[0]);
+            lincomb_words64(&rb[0], a, mC, b, mD, n, &t[0]);
+        } else {
+            lincomb_words64(&ra[0], a, mA, b, mB, n, &t[0]);
+            lincomb_words64(&rb[0], b, mD, a, mC, n, &t[0]);
+        }
+        memcpy(a, &ra[0], n * sizeof(uint64_t));
+        memcpy(b, &rb[0], n * sizeof(uint64_t));
+        if (NULL != u0) {
+            addcomb_words64(&ua[0], u0, mA, u1, mB, m);
+            addcomb_words64(&ub[0], u0, mC, u1, mD, m);
+            memcpy(u0, &ua[0], m * sizeof(uint64_t));
+            memcpy(u1, &ub[0], m * sizeof(uint64_t));
+        }
+        steps += j;
+    }
+}
+
+// gcd(*this, other), gcd(0, 0) = 0
+Bignum Bignum::gcd(const Bignum& other) const
+{
+    const Bignum& x = (compare(*this, other) >= 0) ? *this : other;
+    const Bignum& y = (compare(*this, other) >= 0) ? other : *this;
+    int s = (x.size + 1) >> 1;
+    Bignum g;
+    if (0 == s)
+        return g;
+    vector<uint64_t> a(s), b(s);
+    x.toWords64(&a[0], s);
+    y.toWords64(&b[0], s);
+    gcd_words64(&a[0], &b[0], s, NULL, NULL, 0);
+    g.fromWords64(&a[0], s);
+    return g;
+}
+
+// g = gcd(*this, n) and u with (*this)*u = g mod n, 0 <= u < n; n > 0
+Bignum Bignum::gcd_ext(const Bignum& n, Bignum& u) const
+{
+    int s = (n.size + 1) >> 1;
+    vector<uint64_t> a(s), b(s), u0(s, 0), u1(s, 0);
+    n.toWords64(&a[0], s);
+    ((compare(*this, n) >= 0) ? mod(n) : *this).toWords64(&b[0], s);
+    u1[0] = 1;
+    int steps = gcd_words64(&a[0], &b[0], s, &u0[0], &u1[0], s);
+    Bignum g;
+    g.fromWords64(&a[0], s);
+    u.fromWords64(&u0[0], s);
+    // t_i < 0 for even i > 0: u = n - |t_i|
+    if (0 == (steps & 1) && 0 != u.size)
+        u = n.sub2(u);
+    return g;
+}
+
+// inverse = (*this)^(-1) mod n; false if there is none, gcd(*this, n) != 1
+bool Bignum::mod_inverse(const Bignum& n, Bignum& inverse) const
+{
+    Bignum g = gcd_ext(n, inverse);
+    return 1 == g.size && 1 == g.num[0];
+}
+
+Bignum Bignum::mod_exp_binary(const Bignum& exp, const Bignum& n) const
+{
+    PlainReducer red(n);
+    return exp_binary(red, *this, exp);
+}
+
+Bignum Bignum::mod_exp_binary_Blakley_shiftadd(const Bignum& exp, const Bignum& n) const
+{
+    BlakleyReducer red(n);
+    return exp_binary(red, *this, exp);
+}
+
+Bignum Bignum::mod_exp_mary(const Bignum& exp, const Bignum& n/*modular*/) const
+{
+    PlainReducer red(n);
+    return exp_mary(red, *this, exp);
+}
+
+Bignum Bignum::mod_exp_mary_Blakley_shiftadd(const Bignum& exp, const Bignum& n) const
+{
+    BlakleyReducer red(n);
+    return exp_mary(red, *this, exp);
+}
+
+// decompose exp into s r-bit words
+void Bignum::decompose_exp(const Bignum& exp, int r, vector<uint32_t>& F, int s)
+{
+    for (int i = 0; i < s; i++)
+        F.push_back(exp.getBits(i*r, r));
+}
+
+// window width for a k-bit exponent: the table costs 2^(w-1) multiplications,
+// the windows save about k/(w+1) of the k multiplications of the binary method
+int Bignum::sliding_window_width(int k)
+{
+    if (window_width > 0)
+        return window_width;
+    if (k > 671) return 6;
+    if (k > 239) return 5;
+    if (k > 79)  return 4;
+    if (k > 23)  return 3;
+    return 1;
+}
+
+// prod base[i]^exp[i] mod n; more than MAX_MULTI_EXP bases are done in groups
+Bignum Bignum::mod_exp_multi(const Bignum* base, const Bignum* exp, int count, const Bignum& n)
+{
+    Bignum result = Bignum(1).mod(n);
+    for (int i = 0; i < count; i += MAX_MULTI_EXP) {
+        int group = (count - i < MAX_MULTI_EXP) ? count - i : MAX_MULTI_EXP;
+        Bignum part;
+        if (1 == n.getBit(0)) {
+            MontgomeryReducer red(n);
+            part = exp_multi(red, base + i, exp + i, group);
+        } else {
+            BarrettReducer red(n);
+            part = exp_multi(red, base + i, exp + i, group);
+        }
+        result = (0 == i) ? part : result.multMod(part, n);
+    }
+    return result;
+}
+
+Bignum Bignum::mod_exp_sliding(const Bignum& exp, const Bignum& n) const
+{
+    PlainReducer red(n);
+    return exp_sliding(red, *this, exp);
+}
+
+// a*b mod n with Blakley's method, on 64-bit words (BlakleyReducer)
+Bignum Bignum::Blakley_shiftadd(const Bignum& a, const Bignum& b, const Bignum& n)
+{
+    BlakleyReducer red(n);
+    vector<uint64_t> A, B, R;
+    red.enter(A, a);
+    red.enter(B, b);
+    red.mult(R, A, B);
+    Bignum result;
+    red.leave(result, R);
+    return result;
+}
+
+// n_prime = -n^(-1) mod 2^64, n must be odd
+uint64_t Bignum::Montgomery_nprime(const Bignum& n)
+{
+    uint64_t n0 = n.num[0];
+    if (n.size > 1)
+        n0 |= static_cast<uint64_t>(n.num[1]) << 32;
+    uint64_t inv = n0;          // correct to 3 bits since n0*n0 = 1 mod 8
+    for (int i = 0; i < 5; i++)
+        inv *= 2 - n0 * inv;    // Newton step doubles the correct bits
+    return 0 - inv;
+}
+
+// R^2 mod n with R = 2^(64*s), s = number of 64-bit words of n;
+// used to enter the Montgomery domain
+Bignum Bignum::Montgomery_R2(const Bignum& n)
+{
+    int s = (n.size + 1) >> 1;
+    Bignum R(1);
+    R.block_shiftL(2*s);
+    R = R.mod(n);
+    return R.multMod(R, n);
+}
+
+// Montgomery product a*b*R^(-1) mod n, requires a < R, b < n, n odd
+Bignum Bignum::Montgomery_mult(const Bignum& a, const Bignum& b, const Bignum& n, uint64_t n_prime)
+{
+    Bignum result;
+    int s = (n.size + 1) >> 1;
+    uint64_t A[LEN >> 1], B[LEN >> 1], N[LEN >> 1];
+    a.toWords64(A, s);
+    b.toWords64(B, s);
+    n.toWords64(N, s);
+    Montgomery_mult_words64(A, A, B, N, n_prime, s, thread_scratch(Montgomery_scratch_words(s)));
+    result.fromWords64(A, s);
+    return result;
+}
+
+// binary method in the Montgomery domain, the conversion happens only once
+// and the loop runs on 64-bit words
+Bignum Bignum::mod_exp_binary_Montgomery(const Bignum& exp, const Bignum& n) const
+{
+    if (0 == n.getBit(0))   // Montgomery needs an odd modulus
+        return mod_exp_binary(exp, n);
+    MontgomeryReducer red(n);
+    return exp_binary(red, *this, exp);
+}
+
+Bignum Bignum::mod_exp_mary_Montgomery(const Bignum& exp, const Bignum& n) const
+{
+    if (0 == n.getBit(0))
+        return mod_exp_mary(exp, n);
+    MontgomeryReducer red(n);
+    return exp_mary(red, *this, exp);
+}
+
+Bignum Bignum::mod_exp_binary_Barrett(const Bignum& exp, const Bignum& n) const
+{
+    BarrettReducer red(n);
+    return exp_binary(red, *this, exp);
+}
+
+Bignum Bignum::mod_exp_mary_Barrett(const Bignum& exp, const Bignum& n) const
+{
+    BarrettReducer red(n);
+    return exp_mary(red, *this, exp);
+}
+
+Bignum Bignum::mod_exp_sliding_Montgomery(const Bignum& exp, const Bignum& n) const
+{
+    if (0 == n.getBit(0))
+        return mod_exp_sliding(exp, n);
+    MontgomeryReducer red(n);
+    return exp_sliding(red, *this, exp);
+}
+
+// sliding window on FixedMontgomeryReducer<Bits>, with the row of the word
+// kernels in use
+template <int Bits>
+static Bignum exp_sliding_fixed(const Bignum& base, const Bignum& exp, const Bignum& n)
+{
+#ifdef KERNEL_DISPATCH
+    if (&word_kernels_adx == word_kernels) {
+        FixedMontgomeryReducer<Bits, FixedRowAdx> red(n);
+        return exp_sliding(red, base, exp);
+    }
+#endif
+    FixedMontgomeryReducer<Bits> red(n);
+    return exp_sliding(red, base, exp);
+}
+
+// sliding window on the fixed-width Montgomery product if n has 1024, 2048,
+// 3072 or 4096 bits' worth of 64-bit words, else mod_exp_sliding_Montgomery
+Bignum Bignum::mod_exp_sliding_fixed(const Bignum& exp, const Bignum& n) const
+{
+    if (0 == n.getBit(0))
+        return mod_exp_sliding(exp, n);
+    switch ((n.size + 1) >> 1) {
+    case 16: return exp_sliding_fixed<1024>(*this, exp, n);
+    case 32: return exp_sliding_fixed<2048>(*this, exp, n);
+    case 48: return exp_sliding_fixed<3072>(*this, exp, n);
+    case 64: return exp_sliding_fixed<4096>(*this, exp, n);
+    default:
+        return mod_exp_sliding_Montgomery(exp, n);
+    }
+}
+
+Bignum Bignum::mod_exp_sliding_Barrett(const Bignum& exp, const Bignum& n) const
+{
+    BarrettReducer red(n);
+    return exp_sliding(red, *this, exp);
+}
+
+// constant time in the exponent. Returns false for an even n, where a
+// variable-time fallback would leak the exponent it is meant to protect, and
+// for an exp wider than the 64-bit words of n, since the window count is set
+// by n alone.
+bool Bignum::mod_exp_fixed_window_ct(const Bignum& exp, const Bignum& n, Bignum& result) const
+{
+    if (0 == n.getBit(0))
+        return false;
+    MontgomeryReducer red(n);
+    if (exp.getTotalBits() > 64 * red.words())
+        return false;
+    result = exp_fixed_window_ct(red, *this, exp);
+    return true;
+}
+
+// RSA private operation c^d mod pq with the Chinese remainder theorem:
+//   m1 = c^dP mod p, m2 = c^dQ mod q        (dP = d mod p-1, dQ = d mod q-1)
+//   h = qInv*(m1 - m2) mod p, m = m2 + h*q  (Garner, qInv = q^(-1) mod p)
+// Each exponentiation has half the modulus and half the exponent bits, about
+// 1/8 of the work of c^d mod n. dP and dQ are private, so both run in
+// constant time; returns false if p or q is even.
+bool Bignum::RSA_private_CRT(const Bignum& p, const Bignum& q, const Bignum& dP,
+                             const Bignum& dQ, const Bignum& qInv, Bignum& m) const
+{
+    Bignum m1, m2;
+    if (!mod_exp_fixed_window_ct(dP, p, m1) || !mod_exp_fixed_window_ct(dQ, q, m2))
+        return false;
+    Bignum m2p = (compare(m2, p) >= 0) ? m2.mod(p) : m2;
+    Bignum diff = (compare(m1, m2p) >= 0) ? m1.sub2(m2p) : m1.add(p).sub2(m2p);
+    Bignum h = qInv.multMod(diff, p);
+    m = m2.add(h.mult(q));
+    return true;
+}
+
+/* end of definition of member functions */
+
+/* start of definition of batch exponentiation
+ * mod_exp_batch runs N independent jobs on a fixed pool of worker threads.
+ * The jobs are dealt round-robin into one deque per worker. A worker takes
+ * jobs from the back of its own deque and, once that is empty, steals from
+ * the front of the others', so the workers that drew the large moduli get
+ * help from the rest. Nothing is shared between jobs, each deque has its own
+ * lock, and a lock is only held to take one job index.
+ */
+
+struct ExpJob {
+    Bignum base;
+    Bignum exp;
+    Bignum n;
+    Bignum result;
+};
+
+class BatchPool {
+    struct WorkQueue {
+        mutex lock;
+        deque<size_t> jobs;
+    };
+    vector<ExpJob>& jobs;
+    vector<WorkQueue> queues;
+    bool take(int id, size_t& job);
+public:
+    vector<int> done;       // jobs run by each worker
+    vector<int> stolen;     // of those, taken from another worker's deque
+    BatchPool(vector<ExpJob>& batch, int threads);
+    void work(int id);
+    void run();
+};
+
+BatchPool::BatchPool(vector<ExpJob>& batch, int threads)
+    : jobs(batch), queues(threads), done(threads, 0), stolen(threads, 0)
+{
+    for (size_t i = 0; i < jobs.size(); i++)
+        queues[i % threads].jobs.push_back(i);
+}
+
+bool BatchPool::take(int id, size_t& job)
+{
+    int threads = static_cast<int>(queues.size());
+    {
+        lock_guard<mutex> guard(queues[id].lock);
+        if (!queues[id].jobs.empty()) {
+            job = queues[id].jobs.back();
+            queues[id].jobs.pop_back();
+            return true;
+        }
+    }
+    for (int i = 1; i < threads; i++) {
+        WorkQueue& victim = queues[(id + i) % threads];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.jobs.empty()) {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            stolen[id]++;
+            return true;
+        }
+    }
+    return false;   // no job is ever added later, so the batch is done
+}
+
+void BatchPool::work(int id)
+{
+    size_t job;
+    while (take(id, job)) {
+        ExpJob& j = jobs[job];
+        j.result = j.base.mod_exp_sliding_Montgomery(j.exp, j.n);
+        done[id]++;
+    }
+}
+
+// the calling thread is worker 0
+void BatchPool::run()
+{
+    vector<thread> workers;
+    for (size_t id = 1; id < queues.size(); id++)
+        workers.push_back(thread(&BatchPool::work, this, static_cast<int>(id)));
+    work(0);
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+// result = base^exp mod n for every job, with the sliding window method and
+// Montgomery multiplication
+void mod_exp_batch(vector<ExpJob>& jobs, int threads, vector<int>* done, vector<int>* stolen)
+{
+    if (threads < 1)
+        threads = 1;
+    BatchPool pool(jobs, threads);
+    pool.run();
+    if (NULL != done)
+        *done = pool.done;
+    if (NULL != stolen)
+        *stolen = pool.stolen;
+}
+
+
+/* multi-lane exponentiation
+ * mod_exp_lanes computes exponentiations of the same size in lockstep, in
+ * groups of lane_engine->lanes, one per lane; the last group is padded. All lanes must run the same sequence of
+ * products, so the exponent is scanned in fixed w-bit windows (the sliding
+ * windows of different exponents would not line up), and each lane picks
+ * its own table entry. Unused lanes and lanes with an even modulus (which
+ * Montgomery cannot handle; those run mod_exp_sliding instead) carry the
+ * dummy job 1^0 mod 3.
+ */
+
+// x as m limbs of `radix` bits into lane l
+static void to_lanes(const Bignum& x, uint64_t* v, int m, int lanes, int l, int radix)
+{
+    for (int i = 0; i < m; i++) {
+        uint64_t limb = 0;
+        for (int done = 0; done < radix; done += 32) {
+            int width = (radix - done < 32) ? radix - done : 32;
+            limb |= static_cast<uint64_t>(x.getBits(i*radix + done, width)) << done;
+        }
+        v[i*lanes + l] = limb;
+    }
+}
+
+static Bignum from_lanes(const uint64_t* v, int m, int lanes, int l, int radix)
+{
+    int words = (m*radix + 63) >> 6;
+    vector<uint64_t> w(words + 1, 0);
+    for (int i = 0; i < m; i++) {
+        int bit = i*radix;
+        uint64_t limb = v[i*lanes + l];
+        w[bit >> 6] |= limb << (bit & 63);
+        if ((bit & 63) + radix > 64)
+            w[(bit >> 6) + 1] |= limb >> (64 - (bit & 63));
+    }
+    Bignum x;
+    x.fromWords64(&w[0], words);
+    return x;
+}
+
+// one group of count <= lanes jobs
+static void mod_exp_lane_group(const Bignum* base, const Bignum* exp, const Bignum* n,
+                               Bignum* result, int count)
+{
+    const int L = lane_engine->lanes;
+    const int radix = lane_engine->radix;
+
+    vector<Bignum> B(L, Bignum(1)), E(L, Bignum(0)), N(L, Bignum(3));
+    int bits = 2, k = 0;
+    for (int l = 0; l < count; l++) {
+        if (0 == n[l].getBit(0)) {
+            result[l] = base[l].mod_exp_sliding(exp[l], n[l]);
+            continue;
+        }
+        B[l] = base[l];
+        E[l] = exp[l];
+        N[l] = n[l];
+        if (n[l].getTotalBits() > bits)
+            bits = n[l].getTotalBits();
+        if (exp[l].getTotalBits() > k)
+            k = exp[l].getTotalBits();
+    }
+    int m = (bits + 2 + radix - 1) / radix;     // R = 2^(radix*m) > 4n
+
+    // per lane: n, n' = -n^(-1) mod 2^radix, R^2 mod n, and 1 and base in the domain
+    uint64_t mask = (1ULL << radix) - 1;
+    vector<uint64_t> Nv(m*L), np(L), R2(m*L), unit(m*L, 0), t((m+1)*L);
+    vector<uint64_t> one(m*L), M(m*L);
+    for (int l = 0; l < L; l++) {
+        to_lanes(N[l], &Nv[0], m, L, l, radix);
+        np[l] = Bignum::Montgomery_nprime(N[l]) & mask;
+        Bignum R(1);
+        R.block_shiftL((radix*m) >> 5);
+        for (int i = 0; i < ((radix*m) & 31); i++)
+            R.shiftL();
+        R = R.mod(N[l]);
+        to_lanes(R, &one[0], m, L, l, radix);
+        to_lanes(R.multMod(R, N[l]), &R2[0], m, L, l, radix);
+        to_lanes((Bignum::compare(B[l], N[l]) >= 0) ? B[l].mod(N[l]) : B[l], &M[0], m, L, l, radix);
+        unit[l] = 1;
+    }
+    lane_engine->mont_mult(&M[0], &M[0], &R2[0], &Nv[0], &np[0], m, &t[0]);
+
+    // table[d] = base^d in the domain, fixed w-bit windows
+    int w = Bignum::sliding_window_width(k);
+    vector< vector<uint64_t> > table(1 << w);
+    table[0] = one;
+    table[1] = M;
+    for (int d = 2; d < (1 << w); d++) {
+        table[d].resize(m*L);
+        lane_engine->mont_mult(&table[d][0], &table[d-1][0], &M[0], &Nv[0], &np[0], m, &t[0]);
+    }
+
+    vector<uint64_t> C(one), G(m*L);
+    int windows = (k + w - 1) / w;
+    for (int i = windows-1; i >= 0; i--) {
+        for (int l = 0; l < L; l++) {
+            const vector<uint64_t>& entry = table[E[l].getBits(i*w, w)];
+            for (int j = 0; j < m; j++)
+                G[j*L + l] = entry[j*L + l];
+        }
+        if (windows-1 == i) {
+            C = G;
+            continue;
+        }
+        for (int j = 0; j < w; j++)
+            lane_engine->mont_mult(&C[0], &C[0], &C[0], &Nv[0], &np[0], m, &t[0]);
+        lane_engine->mont_mult(&C[0], &C[0], &G[0], &Nv[0], &np[0], m, &t[0]);
+    }
+
+    // leave the domain, the product with 1 is below 2n
+    lane_engine->mont_mult(&C[0], &C[0], &unit[0], &Nv[0], &np[0], m, &t[0]);
+    for (int l = 0; l < count; l++) {
+        if (0 == n[l].getBit(0))
+            continue;
+        result[l] = from_lanes(&C[0], m, L, l, radix);
+        if (Bignum::compare(result[l], N[l]) >= 0)
+            result[l] = result[l].sub2(N[l]);
+    }
+}
+
+void mod_exp_lanes(const Bignum* base, const Bignum* exp, const Bignum* n, Bignum* result, int count)
+{
+    const int L = lane_engine->lanes;
+    for (int i = 0; i < count; i += L)
+        mod_exp_lane_group(base + i, exp + i, n + i, result + i, (count - i < L) ? count - i : L);
+}
+
+/* end of definition of batch exponentiation */
+
+/* start of definition of prime generation
+ * gen_prime draws a random odd start c with its top two bits set (so the
+ * product of two such primes has exactly twice the bits) and sieves the
+ * window c, c+2, .., c+2(SIEVE_WINDOW-1) with the first SIEVE_PRIMES odd
+ * primes. The residues c mod p are computed once per start; candidate c+2j
+ * is divisible by p for j = -c/2 mod p, and every p-th one after it, so a
+ * window costs one pass over the table and no division of a Bignum. The next
+ * window starts at c + 2*SIEVE_WINDOW and its residues are updated with one
+ * word addition each. The survivors get Miller-Rabin rounds on the
+ * Montgomery reducer of the candidate, which is built once and shared by
+ * all rounds. With several threads every thread sieves its own random
+ * windows and the first prime found stops the others.
+ * The candidates and the Miller-Rabin bases come from the kernel CSPRNG
+ * (getrandom, or /dev/urandom), read by each thread into its own buffer,
+ * so no two threads or calls share a stream and nothing depends on a seed.
+ */
+
+struct PrimeStats {
+    long windows;               // sieve windows
+    long candidates;            // odd numbers scanned in them
+    long tests;                 // survivors of the sieve, Miller-Rabin tested
+    long rounds;                // Miller-Rabin rounds run
+};
+
+// the first SIEVE_PRIMES odd primes, sieve of Eratosthenes
+static const vector<uint32_t>& sieve_primes()
+{
+    static const vector<uint32_t> primes = [] {
+        vector<uint32_t> p;
+        vector<bool> composite(1 << 15, false);
+        for (uint32_t i = 3; p.size() < SIEVE_PRIMES; i += 2) {
+            if (composite[i])
+                continue;
+            p.push_back(i);
+            for (uint32_t j = i*i; j < composite.size(); j += 2*i)
+                composite[j] = true;
+        }
+        return p;
+    }();
+    return primes;
+}
+
+// rounds for an error probability below 2^-80 on random candidates
+// (Damgard, Landrock and Pomerance, as in OpenSSL before 3.0)
+static int miller_rabin_rounds(int bits)
+{
+    return (bits >= 3747) ?  3 :
+           (bits >= 1345) ?  4 :
+           (bits >=  476) ?  5 :
+           (bits >=  400) ?  6 :
+           (bits >=  347) ?  7 :
+           (bits >=  308) ?  8 :
+           (bits >=   55) ? 27 : 34;
+}
+
+// 64-bit words from the kernel CSPRNG, SECURE_RANDOM_WORDS at a time; one
+// instance per thread
+class SecureRandom {
+    uint64_t buffer[SECURE_RANDOM_WORDS];
+    int used;
+    void fill();
+public:
+    SecureRandom() : used(SECURE_RANDOM_WORDS) {}
+    uint64_t operator()()
+    {
+        if (SECURE_RANDOM_WORDS == used)
+            fill();
+        return buffer[used++];
+    }
+};
+
+// getrandom(2) where the kernel has it, else /dev/urandom; there is no
+// weaker fallback, a prime from a predictable source is worse than none
+void SecureRandom::fill()
+{
+    unsigned char* p = reinterpret_cast<unsigned char*>(buffer);
+    size_t left = sizeof(buffer);
+#ifdef SYS_getrandom
+    while (left > 0) {
+        long got = syscall(SYS_getrandom, p, left, 0);
+        if (got < 0 && EINTR == errno)
+            continue;
+        if (got <= 0)
+            break;
+        p += got;
+        left -= got;
+    }
+#endif
+    if (left > 0) {
+        int fd = open("/dev/urandom", O_RDONLY);
+        while (fd >= 0 && left > 0) {
+            ssize_t got = read(fd, p, left);
+            if (got < 0 && EINTR == errno)
+                continue;
+            if (got <= 0)
+                break;
+            p += got;
+            left -= got;
+        }
+        if (fd >= 0)
+            close(fd);
+    }
+    if (left > 0) {
+        fprintf(stderr, "no random source: getrandom and /dev/urandom failed\n");
+        abort();
+    }
+    used = 0;
+}
+
+// random number below 2^bits
+static Bignum random_bits(SecureRandom& rng, int bits)
+{
+    int words = (bits + 63) >> 6;
+    vector<uint64_t> w(words);
+    for (int i = 0; i < words; i++)
+        w[i] = rng();
+    if (0 != (bits & 63))
+        w[words-1] &= ~0ULL >> (64 - (bits & 63));
+    Bignum x;
+    x.fromWords64(&w[0], words);
+    return x;
+}
+
+// n odd, n > 3: false if one of `rounds` random bases shows n composite
+static bool miller_rabin(const Bignum& n, int rounds, SecureRandom& rng, PrimeStats& stats)
+{
+    Bignum one(1);
+    Bignum n1 = n.sub2(one);
+    Bignum d = n1;
+    int s = 0;
+    while (0 == d.getBit(0)) {
+        d.shiftR();
+        s++;
+    }
+    int bits = n.getTotalBits();
+    MontgomeryReducer red(n);
+    MontgomeryReducer::Elem x, minus_one;
+    red.enter(minus_one, n1);
+    for (int i = 0; i < rounds; i++) {
+        stats.rounds++;
+        // a in [2, n-2]: below 2^(bits-1) <= n-1
+        Bignum a = random_bits(rng, bits - 1);
+        if (a.getTotalBits() < 2)
+            a = Bignum(2);
+        Bignum y = exp_sliding(red, a, d);
+        if (0 == Bignum::compare(y, one) || 0 == Bignum::compare(y, n1))
+            continue;
+        // the squarings stay in the domain, where n-1 is minus_one
+        red.enter(x, y);
+        int j = 1;
+        for (; j < s; j++) {
+            red.sqr(x, x);
+            if (x == minus_one)
+                break;
+        }
+        if (j == s)
+            return false;
+    }
+    return true;
+}
+
+// one sieving thread: random windows until a prime turns up or `found` is set
+static void gen_prime_worker(int bits, atomic<bool>* found, mutex* lock, Bignum* result,
+                             PrimeStats* stats)
+{
+    const vector<uint32_t>& primes = sieve_primes();
+    SecureRandom rng;
+    int rounds = miller_rabin_rounds(bits);
+    vector<uint32_t> residue(primes.size());
+    vector<bool> sieve(SIEVE_WINDOW);
+    while (!found->load()) {
+        Bignum c = random_bits(rng, bits - 2);
+        vector<uint64_t> w((bits + 63) >> 6, 0);
+        c.toWords64(&w[0], static_cast<int>(w.size()));
+        w[(bits-1) >> 6] |= 1ULL << ((bits-1) & 63);
+        w[(bits-2) >> 6] |= 1ULL << ((bits-2) & 63);
+        w[0] |= 1;
+        c.fromWords64(&w[0], static_cast<int>(w.size()));
+        for (size_t i = 0; i < primes.size(); i++)
+            residue[i] = c.mod_word(primes[i]);
+
+        // windows from c on, until the candidates grow past `bits` bits
+        bool overflow = false;
+        while (!overflow && !found->load()) {
+            stats->windows++;
+            sieve.assign(SIEVE_WINDOW, false);
+            for (size_t i = 0; i < primes.size(); i++) {
+                uint32_t p = primes[i];
+                // c + 2j = 0 mod p: j = (p - r) * (p+1)/2 mod p
+                uint64_t j = static_cast<uint64_t>((p - residue[i]) % p) * ((p + 1) >> 1) % p;
+                for (; j < SIEVE_WINDOW; j += p)
+                    sieve[j] = true;
+            }
+            for (int j = 0; j < SIEVE_WINDOW && !found->load(); j++) {
+                stats->candidates++;
+                if (sieve[j])
+                    continue;
+                Bignum candidate = c.add(Bignum(2*j));
+                if (candidate.getTotalBits() > bits) {
+                    overflow = true;
+                    break;
+                }
+                stats->tests++;
+                if (miller_rabin(candidate, rounds, rng, *stats)) {
+                    lock_guard<mutex> guard(*lock);
+                    if (!found->load()) {
+                        *result = candidate;
+                        found->store(true);
+                    }
+                    return;
+                }
+            }
+            c.addTo(Bignum(2*SIEVE_WINDOW));
+            for (size_t i = 0; i < primes.size(); i++)
+                residue[i] = (residue[i] + 2*SIEVE_WINDOW) % primes[i];
+        }
+    }
+}
+
+// random prime of exactly bits bits, bits >= MIN_PRIME_BITS, with its top
+// two bits set; threads sieve independent windows
+Bignum gen_prime(int bits, int threads, vector<PrimeStats>* stats)
+{
+    if (threads < 1)
+        threads = 1;
+    atomic<bool> found(false);
+    mutex lock;
+    Bignum result;
+    vector<PrimeStats> worker_stats(threads, PrimeStats());
+    vector<thread> workers;
+    for (int t = 1; t < threads; t++)
+        workers.push_back(thread(gen_prime_worker, bits, &found, &lock, &result, &worker_stats[t]));
+    gen_prime_worker(bits, &found, &lock, &result, &worker_stats[0]);
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    if (NULL != stats)
+        *stats = worker_stats;
+    return result;
+}
+
+/* end of definition of prime generation */
+
+/* start of definition of streaming batch
+ * For bulk jobs from a file or a pipe: records of (base, exponent, modulus)
+ * are read, computed and written in three overlapping stages.
+ *   - The reader (the calling thread) parses the input, a memory-mapped file
+ *     or stdin read in blocks, into chunks of STREAM_CHUNK jobs.
+ *   - The workers take whole chunks, run mod_exp_sliding_Montgomery on every
+ *     job and format the results into the chunk's output bytes.
+ *   - The writer writes the chunks strictly in input order, so a chunk that
+ *     finished early waits for the ones before it.
+ * At most STREAM_IN_FLIGHT chunks per worker are between the reader and the
+ * writer; the reader waits for the writer when they are all taken, so the
+ * memory does not grow with the input.
+ *
+ * Formats (-f):
+ *   hex  one record per line, three hex numbers separated by blanks; empty
+ *        lines and lines starting with # are skipped. One hex number per
+ *        line out.
+ *   bin  every number is a 4-byte big-endian length followed by that many
+ *        big-endian bytes; three per record in, one per record out.
+ */
+
+enum StreamFormat { STREAM_HEX, STREAM_BIN };
+
+// the input, a memory-mapped file or stdin through a buffer
+class StreamInput {
+    const char* data;
+    size_t pos, end;
+    void* mapped;
+    size_t mapped_size;
+    int fd;                         // stdin, -1 for a mapped file
+    vector<char> buf;
+public:
+    StreamInput() : data(NULL), pos(0), end(0), mapped(NULL), mapped_size(0), fd(-1) {}
+    ~StreamInput();
+    bool open(const char* path);    // "-" is stdin
+    bool fill(size_t need);         // at least need bytes at(), false if the input ends first
+    const char* at() const { return data + pos; }
+    size_t available() const { return end - pos; }
+    void skip(size_t bytes) { pos += bytes; }
+};
+
+StreamInput::~StreamInput()
+{
+    if (NULL != mapped)
+        munmap(mapped, mapped_size);
+}
+
+bool StreamInput::open(const char* path)
+{
+    if (0 == strcmp(path, "-")) {
+        fd = STDIN_FILENO;
+        buf.resize(STREAM_READ_BYTES);
+        data = &buf[0];
+        return true;
+    }
+    int file = ::open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+    struct stat st;
+    if (0 != fstat(file, &st)) {
+        close(file);
+        return false;
+    }
+    mapped_size = static_cast<size_t>(st.st_size);
+    if (mapped_size > 0) {
+        mapped = mmap(NULL, mapped_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (MAP_FAILED == mapped) {
+            mapped = NULL;
+            close(file);
+            return false;
+        }
+        madvise(mapped, mapped_size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapped);
+    }
+    end = mapped_size;
+    close(file);
+    return true;
+}
+
+bool StreamInput::fill(size_t need)
+{
+    if (end - pos >= need)
+        return true;
+    if (fd < 0)
+        return false;
+    // move the rest to the front, then read until need bytes are there;
+    // read() returns what the pipe has, the parser does not wait for a full buffer
+    size_t rest = end - pos;
+    memmove(&buf[0], &buf[pos], rest);
+    pos = 0;
+    end = rest;
+    if (buf.size() < need)
+        buf.resize(max(need, 2*buf.size()));
+    data = &buf[0];
+    while (end < need) {
+        ssize_t got = read(fd, &buf[end], buf.size() - end);
+        if (got < 0 && EINTR == errno)
+            continue;
+        if (got <= 0)
+            return false;
+        end += got;
+    }
+    return true;
+}
+
+// the result as one line of hex, or as a length and big-endian bytes
+static void stream_write(string& out, const Bignum& x, StreamFormat format)
+{
+    if (STREAM_HEX == format) {
+        char text[MAX_BITS / 4 + 2];
+        int digits = x.toHex(text, sizeof(text));
+        text[digits] = '\n';
+        out.append(text, digits + 1);
+        return;
+    }
+    unsigned char bytes[4 + MAX_BITS / 8];
+    int len = (x.getTotalBits() + 7) >> 3;
+    store_be32(bytes, len);
+    x.toBytes(bytes + 4, len);
+    out.append(reinterpret_cast<const char*>(bytes), 4 + len);
+}
+
+// the next record into job: 1, 0 at the end of the input, -1 on a malformed
+// record (error says why)
+static int stream_read_hex(StreamInput& in, ExpJob& job, const char** error)
+{
+    for (;;) {
+        // one line
+        size_t len = 0;
+        for (;;) {
+            const char* nl = static_cast<const char*>(memchr(in.at() + len, '\n', in.available() - len));
+            if (NULL != nl) {
+                len = nl - in.at();
+                break;
+            }
+            len = in.available();
+            if (!in.fill(len + 1))
+                break;
+        }
+        if (0 == in.available())
+            return 0;
+        const char* line = in.at();
+        size_t next = (len < in.available()) ? len + 1 : len;
+
+        // up to three blank separated fields
+        const char* field[3];
+        int field_len[3];
+        int fields = 0;
+        size_t i = 0;
+        while (i < len) {
+            if (' ' == line[i] || '\t' == line[i] || '\r' == line[i]) {
+                i++;
+                continue;
+            }
+            if ('#' == line[i] && 0 == fields)
+                break;
+            if (3 == fields) {
+                *error = "more than three numbers";
+                return -1;
+            }
+            field[fields] = line + i;
+            while (i < len && ' ' != line[i] && '\t' != line[i] && '\r' != line[i])
+                i++;
+            field_len[fields] = static_cast<int>(line + i - field[fields]);
+            fields++;
+        }
+        if (0 == fields) {
+            in.skip(next);
+            continue;
+        }
+        if (3 != fields) {
+            *error = "fewer than three numbers";
+            return -1;
+        }
+        if (!job.base.fromHex(field[0], field_len[0])
+            || !job.exp.fromHex(field[1], field_len[1])
+            || !job.n.fromHex(field[2], field_len[2])) {
+            *error = "not a hex number, or too long";
+            return -1;
+        }
+        in.skip(next);
+        return 1;
+    }
+}
+
+static int stream_read_bin(StreamInput& in, ExpJob& job, const char** error)
+{
+    Bignum* value[3] = { &job.base, &job.exp, &job.n };
+    for (int f = 0; f < 3; f++) {
+        if (!in.fill(4)) {
+            if (0 == f && 0 == in.available())
+                return 0;
+            *error = "truncated record";
+            return -1;
+        }
+        size_t len = load_be32(reinterpret_cast<const unsigned char*>(in.at()));
+        if (len > MAX_BITS / 8) {
+            *error = "number too long";
+            return -1;
+        }
+        if (!in.fill(4 + len)) {
+            *error = "truncated record";
+            return -1;
+        }
+        value[f]->fromBytes(reinterpret_cast<const unsigned char*>(in.at()) + 4, static_cast<int>(len));
+        in.skip(4 + len);
+    }
+    return 1;
+}
+
+struct StreamChunk {
+    vector<ExpJob> jobs;
+    string out;
+    bool computed;
+};
+
+class StreamPipeline {
+    StreamFormat format;
+    FILE* out;
+    size_t max_in_flight;
+    mutex lock;
+    condition_variable work_ready, chunk_done, slot_free;
+    deque<StreamChunk*> work;       // parsed, waiting for a worker
+    deque<StreamChunk*> pending;    // every chunk not yet written, in input order
+    bool closed;                    // the reader is done
+    bool write_failed;
+    void compute();
+    void write();
+public:
+    StreamPipeline(StreamFormat fmt, FILE* output, int workers)
+        : format(fmt), out(output), max_in_flight(STREAM_IN_FLIGHT * workers),
+          closed(false), write_failed(false) {}
+    // the records read and written; after a malformed record error says
+    // why, and the records before it are written
+    long run(StreamInput& in, int workers, const char** error);
+    bool failed() const { return write_failed; }
+};
+
+void StreamPipeline::compute()
+{
+    for (;;) {
+        StreamChunk* chunk;
+        {
+            unique_lock<mutex> guard(lock);
+            while (work.empty() && !closed)
+                work_ready.wait(guard);
+            if (work.empty())
+                return;
+            chunk = work.front();
+            work.pop_front();
+        }
+        for (size_t i = 0; i < chunk->jobs.size(); i++) {
+            ExpJob& job = chunk->jobs[i];
+            job.result = job.base.mod_exp_sliding_Montgomery(job.exp, job.n);
+            stream_write(chunk->out, job.result, format);
+        }
+        lock_guard<mutex> guard(lock);
+        chunk->computed = true;
+        chunk_done.notify_all();
+    }
+}
+
+void StreamPipeline::write()
+{
+    for (;;) {
+        StreamChunk* chunk;
+        {
+            unique_lock<mutex> guard(lock);
+            while (!(pending.empty() ? closed : pending.front()->computed))
+                chunk_done.wait(guard);
+            if (pending.empty())
+                return;
+            chunk = pending.front();
+        }
+        if (!write_failed && chunk->out.size() != fwrite(chunk->out.data(), 1, chunk->out.size(), out))
+            write_failed = true;
+        lock_guard<mutex> guard(lock);
+        pending.pop_front();
+        delete chunk;
+        slot_free.notify_one();
+    }
+}
+
+long StreamPipeline::run(StreamInput& in, int workers, const char** error)
+{
+    vector<thread> threads;
+    for (int i = 0; i < workers; i++)
+        threads.push_back(thread(&StreamPipeline::compute, this));
+    thread writer(&StreamPipeline::write, this);
+
+    long records = 0;
+    bool malformed = false;
+    *error = NULL;
+    while (!malformed) {
+        StreamChunk* chunk = new StreamChunk;
+        chunk->computed = false;
+        chunk->jobs.resize(STREAM_CHUNK);
+        size_t count = 0;
+        while (count < STREAM_CHUNK) {
+            ExpJob& job = chunk->jobs[count];
+            int got = (STREAM_HEX == format) ? stream_read_hex(in, job, error)
+                                             : stream_read_bin(in, job, error);
+            if (got > 0 && 0 == job.n.getSize()) {
+                *error = "the modulus is 0";
+                got = -1;
+            }
+            if (got <= 0) {
+                malformed = (got < 0);
+                break;
+            }
+            count++;
+        }
+        records += count;
+        if (0 == count) {
+            delete chunk;
+            break;
+        }
+        chunk->jobs.resize(count);
+        unique_lock<mutex> guard(lock);
+        while (pending.size() >= max_in_flight)
+            slot_free.wait(guard);
+        pending.push_back(chunk);
+        work.push_back(chunk);
+        work_ready.notify_one();
+        if (count < STREAM_CHUNK)
+            break;
+    }
+
+    {
+        lock_guard<mutex> guard(lock);
+        closed = true;
+        work_ready.notify_all();
+        chunk_done.notify_all();
+    }
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    writer.join();
+    fflush(out);
+    return records;
+}
+
+/* end of definition of streaming batch */
+
+/* start of definition of reducer member functions */
+
+BlakleyReducer::BlakleyReducer(const Bignum& modular)
+    : n(modular)
+{
+    s = (n.getSize() + 1) >> 1;
+    N.resize(s);
+    B.resize(s);
+    x.resize(s + 2);
+    t.resize(s + 1);
+    n.toWords64(&N[0], s);
+    shift = 0;
+    while (0 == (N[s-1] << shift >> 63))
+        shift++;
+    if (shift > 0) {
+        for (int i = s-1; i > 0; i--)
+            N[i] = (N[i] << shift) | (N[i-1] >> (64 - shift));
+        N[0] <<= shift;
+    }
+}
+
+void BlakleyReducer::enter(Elem& r, const Bignum& x)
+{
+    r.resize(s);
+    ((Bignum::compare(x, n) >= 0) ? x.mod(n) : x).toWords64(&r[0], s);
+}
+
+void BlakleyReducer::product(Elem& r, const Elem& a, const Elem& b)
+{
+    // B = b << shift is below N
+    if (shift > 0) {
+        for (int i = s-1; i > 0; i--)
+            B[i] = (b[i] << shift) | (b[i-1] >> (64 - shift));
+        B[0] = b[0] << shift;
+    } else {
+        memcpy(&B[0], &b[0], s * sizeof(uint64_t));
+    }
+    r.resize(s);
+    Blakley_mult_words64(&r[0], &a[0], s, &B[0], &N[0], s, &x[0], &t[0]);
+    if (shift > 0) {
+        for (int i = 0; i < s-1; i++)
+            r[i] = (r[i] >> shift) | (r[i+1] << (64 - shift));
+        r[s-1] >>= shift;
+    }
+}
+
+MontgomeryReducer::MontgomeryReducer(const Bignum& modular)
+    : n(modular)
+{
+    s = (n.getSize() + 1) >> 1;
+    n_prime = Bignum::Montgomery_nprime(n);
+    N.resize(s);
+    R2.resize(s);
+    unit.resize(s);
+    t.resize(Montgomery_scratch_words(s));
+    n.toWords64(&N[0], s);
+    Bignum::Montgomery_R2(n).toWords64(&R2[0], s);
+    Bignum(1).toWords64(&unit[0], s);
+    R1.resize(s);
+    Montgomery_mult_words64(&R1[0], &unit[0], &R2[0], &N[0], n_prime, s, &t[0]); // R mod n
+}
+
+void MontgomeryReducer::enter(Elem& r, const Bignum& x)
+{
+    // the Montgomery product needs x below R
+    r.resize(s);
+    if (x.getSize() > n.getSize())
+        x.mod(n).toWords64(&r[0], s);
+    else
+        x.toWords64(&r[0], s);
+    Montgomery_mult_words64(&r[0], &r[0], &R2[0], &N[0], n_prime, s, &t[0]);     // x*R mod n
+}
+
+void MontgomeryReducer::plain(Elem& r, const Bignum& x)
+{
+    r.resize(s);
+    ((Bignum::compare(x, n) >= 0) ? x.mod(n) : x).toWords64(&r[0], s);
+}
+
+// the product by 1 lands in the low half of t
+void MontgomeryReducer::leave(Bignum& r, const Elem& x)
+{
+    Montgomery_mult_words64(&t[0], &x[0], &unit[0], &N[0], n_prime, s, &t[0]);
+    r.fromWords64(&t[0], s);
+}
+
+void MontgomeryReducer::leave_ct(Bignum& r, const Elem& x)
+{
+    Montgomery_mult_ct_words64(&t[0], &x[0], &unit[0], &N[0], n_prime, s, &t[0]);
+    r.fromWords64(&t[0], s);
+}
+
+BarrettReducer::BarrettReducer(const Bignum& modular)
+    : n(modular)
+{
+    s = (n.getSize() + 1) >> 1;
+    N.resize(s + 1);
+    mu.resize(s + 1);
+    x.resize(2*s);
+    q2.resize(2*s + 2);
+    r2.resize(s + 1);
+    scratch.resize(mult_scratch_words(s + 1) + 1);  // the products are on s and s+1 words
+    n.toWords64(&N[0], s + 1);
+
+    // mu = floor((b^(2s) - 1) / n); b^(2s) itself would not fit at the largest
+    // size. It differs from floor(b^(2s) / n) only for n a power of two, which
+    // costs at most one more final subtraction.
+    vector<uint64_t> ones(2*s, ~0ULL);
+    Bignum dividend, rem;
+    dividend.fromWords64(&ones[0], 2*s);
+    dividend.divmod(n, rem).toWords64(&mu[0], s + 1);
+}
+
+// HAC 14.42 on x = x[0..2s-1] < b^(2s)
+void BarrettReducer::reduce(uint64_t* r)
+{
+    // q3 = floor(floor(x / b^(s-1)) * mu / b^(s+1))
+    mult_fast_words64(&q2[0], &x[s-1], s + 1, &mu[0], s + 1, &scratch[0]);
+    const uint64_t* q3 = &q2[s+1];
+    // r2 = q3*n mod b^(s+1), only the low half of the product
+    memset(&r2[0], 0, (s + 1) * sizeof(uint64_t));
+    for (int i = 0; i <= s; i++)
+        addmul_words64(&r2[i], &N[0], s + 1 - i, q3[i]);
+    // x mod b^(s+1) - r2 is x - q3*n, less than 4n
+    sub_words64(&r2[0], &x[0], &r2[0], s + 1);
+    while (compare_words64(&r2[0], &N[0], s + 1) >= 0) {
+        COUNT(OP_RED_SUB);
+        sub_words64(&r2[0], &r2[0], &N[0], s + 1);
+    }
+    memcpy(r, &r2[0], s * sizeof(uint64_t));
+}
+
+void BarrettReducer::enter(Elem& r, const Bignum& y)
+{
+    r.resize(s);
+    if (Bignum::compare(y, n) >= 0)
+        y.mod(n).toWords64(&r[0], s);
+    else
+        y.toWords64(&r[0], s);
+}
+
+/* end of definition of reducer member functions */
+
+
+/* start of definition of local functions */
+
+static unsigned int rand_seed;  // srand() seed of the tests, -s to repeat a run
+
+// seconds from the first call, on the monotonic clock
+double read_timer()
+{
+    static bool initialized = false;
+    static struct timespec start;
+    struct timespec end;
+    if( !initialized )
+    {
+        clock_gettime( CLOCK_MONOTONIC, &start );
+        initialized = true;
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &end );
+
+    return (end.tv_sec - start.tv_sec) + 1.0e-9 * (end.tv_nsec - start.tv_nsec);
+}
+
+static void op_counters_reset()
+{
+    memset(&op_counters, 0, sizeof(op_counters));
+}
+
+// the counts since op_counters_reset, if compiled in (BIGNUM_COUNTERS)
+static void op_counters_print()
+{
+    if (!op_counters_enabled)
+        return;
+    const uint64_t* c = op_counters.count;
+    printf("counts: ");
+    for (int i = 0; i < OP_COUNTERS; i++)
+        printf("%s %llu%s", op_counter_names[i], static_cast<unsigned long long>(c[i]),
+               (i + 1 < OP_COUNTERS) ? ", " : "\n");
+    uint64_t products = c[OP_RED_MULT] + c[OP_RED_SQR];
+    if (products > 0)
+        printf("        %llu squarings, %llu multiplications, %.3lf subtractions of n per product\n",
+               static_cast<unsigned long long>(c[OP_RED_SQR]),
+               static_cast<unsigned long long>(c[OP_RED_MULT]),
+               static_cast<double>(c[OP_RED_SUB]) / products);
+}
+
+struct ExpMethod {
+    const char* name;           // short name, for the benchmark
+    const char* title;
+    const char* exponentiation;
+    const char* multiplication;
+    Bignum (Bignum::*run)(const Bignum& exp, const Bignum& n) const;
+    // instead of run, for the methods that refuse some n
+    bool (Bignum::*run_checked)(const Bignum& exp, const Bignum& n, Bignum& result) const;
+};
+
+// false if the method refuses n
+static bool exp_method_run(const ExpMethod& m, const Bignum& base, const Bignum& exp,
+                           const Bignum& n, Bignum& result)
+{
+    if (NULL != m.run) {
+        result = (base.*m.run)(exp, n);
+        return true;
+    }
+    return (base.*m.run_checked)(exp, n, result);
+}
+
+static const ExpMethod exp_methods[] = {
+    { "binary", "Basic implementation.", "binary method", "standard multiplication...",
+      &Bignum::mod_exp_binary },
+    { "mary", "Exponentiation optimization.", "m-ary method", "standard multiplication...",
+      &Bignum::mod_exp_mary },
+    { "binary_Blakley", "Multiplication optimization.", "binary method", "shift-add (Blakley method)",
+      &Bignum::mod_exp_binary_Blakley_shiftadd },
+    { "mary_Blakley", "Multiplication optimization.", "m-ary method", "shift-add (Blakley method)",
+      &Bignum::mod_exp_mary_Blakley_shiftadd },
+    { "binary_Montgomery", "Montgomery multiplication.", "binary method", "Montgomery product (64-bit words)",
+      &Bignum::mod_exp_binary_Montgomery },
+    { "mary_Montgomery", "Montgomery multiplication.", "m-ary method", "Montgomery product (64-bit words)",
+      &Bignum::mod_exp_mary_Montgomery },
+    { "binary_Barrett", "Barrett reduction.", "binary method", "standard multiplication, Barrett reduction",
+      &Bignum::mod_exp_binary_Barrett },
+    { "mary_Barrett", "Barrett reduction.", "m-ary method", "standard multiplication, Barrett reduction",
+      &Bignum::mod_exp_mary_Barrett },
+    { "sliding_Montgomery", "Sliding window.", "sliding window method", "Montgomery product (64-bit words)",
+      &Bignum::mod_exp_sliding_Montgomery },
+    { "sliding_Barrett", "Sliding window.", "sliding window method", "standard multiplication, Barrett reduction",
+      &Bignum::mod_exp_sliding_Barrett },
+    { "sliding_fixed", "Sliding window, fixed width.", "sliding window method", "Montgomery product, width fixed at compile time",
+      &Bignum::mod_exp_sliding_fixed },
+    { "fixed_window_ct", "Constant time.", "fixed window method, masked table scan", "Montgomery product (64-bit words), masked subtraction",
+      NULL, &Bignum::mod_exp_fixed_window_ct },
+};
+static const int exp_method_count = sizeof(exp_methods) / sizeof(exp_methods[0]);
+
+// FixedMontgomeryReducer<Bits, Row> against MontgomeryReducer, for a random
+// n with its top bit set and for 2^Bits - 1: entering a, b = n - 1, their
+// product and square, and a^exp for a 256-bit exp; the number that differ
+template <int Bits, class Row>
+static int check_fixed_width()
+{
+    const int words = Bits / 64;
+    vector<uint64_t> w(words);
+    Bignum n[2], exp;
+    n[0].genBignum(Bits);
+    n[0].toWords64(&w[0], words);
+    w[words-1] |= static_cast<uint64_t>(1) << 63;
+    w[0] |= 1;
+    n[0].fromWords64(&w[0], words);
+    w.assign(words, ~static_cast<uint64_t>(0));
+    n[1].fromWords64(&w[0], words);
+    exp.genBignum(256);
+
+    int errors = 0;
+    for (int k = 0; k < 2; k++) {
+        FixedMontgomeryReducer<Bits, Row> fixed(n[k]);
+        MontgomeryReducer mont(n[k]);
+        typename FixedMontgomeryReducer<Bits, Row>::Elem fa, fb, fr;
+        MontgomeryReducer::Elem ma, mb, mr;
+        Bignum a, b = n[k].sub2(Bignum(1)), x, y;
+        a.genBignum(Bits);      // may be above n
+        fixed.enter(fa, a);
+        fixed.enter(fb, b);
+        mont.enter(ma, a);
+        mont.enter(mb, b);
+        fixed.leave(x, fa);
+        mont.leave(y, ma);
+        errors += (0 != Bignum::compare(x, y));
+        fixed.mult(fr, fa, fb);
+        mont.mult(mr, ma, mb);
+        fixed.leave(x, fr);
+        mont.leave(y, mr);
+        errors += (0 != Bignum::compare(x, y));
+        fixed.sqr(fr, fb);
+        mont.sqr(mr, mb);
+        fixed.leave(x, fr);
+        mont.leave(y, mr);
+        errors += (0 != Bignum::compare(x, y));
+        errors += (0 != Bignum::compare(exp_sliding(fixed, a, exp), exp_sliding(mont, a, exp)));
+    }
+    return errors;
+}
+
+// every width modexp instantiates from fixed_bignum.h, on the row
+template <class Row>
+static int check_fixed_widths()
+{
+    return check_fixed_width<1024, Row>() + check_fixed_width<2048, Row>()
+         + check_fixed_width<3072, Row>() + check_fixed_width<4096, Row>();
+}
+
+void test8(int bits)
+{
+    srand (rand_seed);
+
+    Bignum M;
+    M.genBignum(bits);
+    printf("  M = "); M.print(); printf("\n");
+
+    Bignum exp;
+    exp.genBignum(bits);
+    printf("exp = "); exp.print(); printf("\n");
+
+    Bignum n;
+    n.genBignum(bits);
+    if (0 == n.getBit(0))   // odd modulus, as in RSA/DH, so Montgomery applies
+        n = n.add(Bignum(1));
+    printf("  n = "); n.print(); printf("\n");
+
+    printf("m-ary: m = %d\n", M_ARY);
+    printf("sliding window: w = %d\n\n", Bignum::sliding_window_width(exp.getTotalBits()));
+    const ExpMethod* methods = exp_methods;
+    int count = exp_method_count;
+    vector<Bignum> re(count);
+    vector<bool> refused(count, false);
+
+    for (int i = 0; i < count; i++) {
+        printf("%s \n", methods[i].title);
+        printf("           exponentiation - %s\n", methods[i].exponentiation);
+        printf("           multiplication - %s\n\n", methods[i].multiplication);
+        op_counters_reset();
+        double seconds = read_timer();
+        refused[i] = !exp_method_run(methods[i], M, exp, n, re[i]);
+        seconds = read_timer() - seconds;
+        if (refused[i])
+            printf("re%d refuses n!\n", i+1);
+        else {
+            printf("re%d = ", i+1); re[i].print(); printf("\n");
+        }
+        printf("\ntime = %lf\n", seconds);
+        op_counters_print();
+        printf("\n");
+    }
+
+    for (int i = 1; i < count; i++) {
+        if (!refused[i] && 0 != Bignum::compare(re[0], re[i]))
+            printf("re%d differs from re1!\n", i+1);
+    }
+
+    // sliding_fixed above runs only at the width of n, if it is one of them
+    int errors = check_fixed_widths<FixedRow>();
+    const char* rows = "portable";
+#ifdef KERNEL_DISPATCH
+    CpuFeatures f = cpu_features();
+    if (f.bmi2 && f.adx) {
+        errors += check_fixed_widths<FixedRowAdx>();
+        rows = "portable and adx";
+    }
+#endif
+    printf("fixed-width Montgomery, 1024 to 4096 bits, %s rows: %s\n\n",
+           rows, (0 == errors) ? "same as MontgomeryReducer" : "differs from MontgomeryReducer!");
+
+    // fixed base: the tables are built once per (M, n), then reused
+    printf("Fixed-base comb. \n");
+    printf("           exponentiation - Lim-Lee comb, h = %d, v = %d\n", comb_teeth, comb_tables);
+    printf("           multiplication - Montgomery product (64-bit words)\n\n");
+    double seconds = read_timer();
+    FixedBaseComb<MontgomeryReducer> comb(M, n, bits, comb_teeth, comb_tables);
+    seconds = read_timer() - seconds;
+    printf("precomputation: %d entries, time = %lf\n", static_cast<int>(comb.table_entries()), seconds);
+    op_counters_reset();
     seconds = read_timer();
-    Bignum re1 = M.mod_exp_binary(exp, n);
+    Bignum fixed = comb.pow(exp);
     seconds = read_timer() - seconds;
-    printf("re1 = "); re1.print(); printf("\n");
-    printf("\ntime = %lf\n\n", seconds);
+    printf("re%d = ", count+1); fixed.print(); printf("\n");
+    printf("\ntime = %lf\n", seconds);
+    op_counters_print();
+    printf("\n");
+    if (0 != Bignum::compare(re[0], fixed))
+        printf("re%d differs from re1!\n", count+1);
 
-    printf("Exponentiation optimization. \n");
-    printf("           exponentiation - m-ary (m=%d) method\n", M_ARY);
-    printf("           multiplication - standard multiplication...\n\n");
+    // M^exp * h^b mod n, as in signature verification
+    Bignum bases[2], exps[2];
+    bases[0] = M;
+    exps[0] = exp;
+    bases[1].genBignum(bits);
+    exps[1].genBignum(bits);
+    printf("Multi-exponentiation M^exp * h^b. \n");
+    printf("           exponentiation - two sliding window exponentiations and multMod\n");
+    printf("           multiplication - Montgomery product (64-bit words)\n\n");
+    op_counters_reset();
     seconds = read_timer();
-    Bignum re2 = M.mod_exp_mary(exp, n);
+    Bignum separate = M.mod_exp_sliding_Montgomery(exp, n).multMod(
+        bases[1].mod_exp_sliding_Montgomery(exps[1], n), n);
     seconds = read_timer() - seconds;
-    printf("re2 = "); re2.print(); printf("\n");
-    printf("\ntime = %lf\n\n", seconds);
+    printf("re%d = ", count+2); separate.print(); printf("\n");
+    printf("\ntime = %lf\n", seconds);
+    op_counters_print();
+    printf("\n");
 
-    printf("Multiplication optimization. \n");
-    printf("           exponentiation - binary method\n");
-    printf("           multiplication - shift-add (Blakley method)\n\n");
+    printf("Multi-exponentiation M^exp * h^b. \n");
+    printf("           exponentiation - Straus, one squaring chain, joint table\n");
+    printf("           multiplication - Montgomery product (64-bit words)\n\n");
+    op_counters_reset();
     seconds = read_timer();
-    Bignum re3 = M.mod_exp_binary_Blakley_shiftadd(exp, n);
+    Bignum joint = Bignum::mod_exp_multi(bases, exps, 2, n);
+    seconds = read_timer() - seconds;
+    printf("re%d = ", count+3); joint.print(); printf("\n");
+    printf("\ntime = %lf\n", seconds);
+    op_counters_print();
+    printf("\n");
+    if (0 != Bignum::compare(separate, joint))
+        printf("re%d differs from re%d!\n", count+3, count+2);
+}
+
+
+// a batch with a mix of sizes (bits, bits/2 and bits/4), run once on one
+// thread and once on the pool
+void test_batch(int bits, int count, int threads)
+{
+    srand (rand_seed);
+
+    vector<ExpJob> jobs(count);
+    for (int i = 0; i < count; i++) {
+        int b = bits >> (i % 3);
+        if (b < 16)
+            b = 16;
+        jobs[i].base.genBignum(b);
+        jobs[i].exp.genBignum(b);
+        jobs[i].n.genBignum(b);
+        if (0 == jobs[i].n.getBit(0))
+            jobs[i].n = jobs[i].n.add(Bignum(1));
+    }
+    printf("batch: %d jobs of %d, %d and %d bits\n\n", count, bits, bits >> 1, bits >> 2);
+
+    double seconds_one = read_timer();
+    mod_exp_batch(jobs, 1, NULL, NULL);
+    seconds_one = read_timer() - seconds_one;
+    vector<Bignum> reference(count);
+    for (int i = 0; i < count; i++)
+        reference[i] = jobs[i].result;
+    printf("1 thread:   time = %lf, %.1lf jobs/s\n", seconds_one, count / seconds_one);
+
+    vector<int> done, stolen;
+    double seconds = read_timer();
+    mod_exp_batch(jobs, threads, &done, &stolen);
+    seconds = read_timer() - seconds;
+    printf("%d threads: time = %lf, %.1lf jobs/s, speedup = %.2lf\n\n",
+           threads, seconds, count / seconds, seconds_one / seconds);
+    for (int id = 0; id < threads; id++)
+        printf("worker %d: %d jobs, %d stolen\n", id, done[id], stolen[id]);
+
+    for (int i = 0; i < count; i++) {
+        if (0 != Bignum::compare(reference[i], jobs[i].result))
+            printf("job %d differs between the runs!\n", i);
+    }
+}
+
+// one lockstep run of lane_engine->lanes same-size jobs against the jobs
+// one after another
+void test_lanes(int bits)
+{
+    srand (rand_seed);
+
+    int L = lane_engine->lanes;
+    vector<Bignum> base(L), exp(L), n(L), re(L), lanes(L);
+    for (int l = 0; l < L; l++) {
+        base[l].genBignum(bits);
+        exp[l].genBignum(bits);
+        n[l].genBignum(bits);
+        if (0 == n[l].getBit(0))
+            n[l] = n[l].add(Bignum(1));
+    }
+    printf("multi-lane Montgomery: %s, %d lanes, %d-bit limbs\n\n",
+           lane_engine->name, L, lane_engine->radix);
+
+    double seconds_one = read_timer();
+    for (int l = 0; l < L; l++)
+        re[l] = base[l].mod_exp_sliding_Montgomery(exp[l], n[l]);
+    seconds_one = read_timer() - seconds_one;
+    printf("one at a time: time = %lf, %.1lf exponentiations/s\n", seconds_one, L / seconds_one);
+
+    double seconds = read_timer();
+    mod_exp_lanes(&base[0], &exp[0], &n[0], &lanes[0], L);
+    seconds = read_timer() - seconds;
+    printf("lockstep:      time = %lf, %.1lf exponentiations/s, speedup = %.2lf\n\n",
+           seconds, L / seconds, seconds_one / seconds);
+
+    for (int l = 0; l < L; l++) {
+        if (0 != Bignum::compare(re[l], lanes[l]))
+            printf("lane %d differs!\n", l);
+    }
+
+    // more jobs than lanes: two full groups and a padded one, the last job
+    // with an even n
+    int count = 2*L + 3;
+    base.resize(count);
+    exp.resize(count);
+    n.resize(count);
+    lanes.assign(count, Bignum());
+    for (int i = L; i < count; i++) {
+        base[i].genBignum(bits);
+        exp[i].genBignum(bits);
+        n[i].genBignum(bits);
+        if (0 == n[i].getBit(0))
+            n[i] = n[i].add(Bignum(1));
+    }
+    n[count-1] = n[count-1].add(Bignum(1));
+    mod_exp_lanes(&base[0], &exp[0], &n[0], &lanes[0], count);
+    int errors = 0;
+    for (int i = 0; i < count; i++)
+        errors += (0 != Bignum::compare(lanes[i], base[i].mod_exp_sliding(exp[i], n[i])));
+    printf("%d jobs on %d lanes: %s\n", count, L, (0 == errors) ? "same as one at a time" : "differs!");
+}
+
+// test keys (e = 65537), generated for this program only
+struct RSATestKey {
+    int bits;
+    const char* p;
+    const char* q;
+    const char* d;
+};
+
+static const RSATestKey rsa_test_keys[] = {
+    { 2048,
+        "ff79760d3bade735204eabfad70ec66c2599d901b5098c4a4a51ef73265f727d"
+        "0db0b30f1b53365e308e991f7afdecfe2d22e566a6f07128c87dc484d2541687"
+        "d92d01f49b5a5f17e8d359d4ba0a721a29b48bf441a50e16bdfd22cebc389b68"
+        "f446840093ef32fceb1024b82227c360d2dd76483bb886adaa4374a2ad02c29b",
+        "d9951d9d1aa29dd758480a39bfa4856ffae161ae6f29d6276ad98887470412b3"
+        "300634850ea09661058aea58d57a9ba5cff8aee50d9e85947b8b4aeb4e60e28e"
+        "5c0b7331607d07857cc8210d4bae9650c1cf76265a9f8dbc31ea1be9579eba43"
+        "6bc7e16fbc1bf4759c08f0cd2be5994bbdd671712144b2e568bce56b31424eb5",
+        "1fc8f496d8e81a265859e16cfd1c47fb3b8cf6b33ebecb4f639768ad12aee6a3"
+        "18b02ac0d0baf7c2ebd97bbe663572cd0620ca15a0e7785869c2fb0c83214f42"
+        "2ab497dc7d8b1fcdd11c8fb497284ed73994fd64407a145916fc594a99e9ab50"
+        "16c65ff69f44ca7b9a59d832b84200b63ccffb7a28d5552994e999c971614571"
+        "f5e56398a8b838fdd9aff86d713d11cc3570143ca3341a94bb32a7f7c1e46711"
+        "4c6ec4d14dc7e497906058884e35f1f9009115bb6ca720d0bae355bbc6bffa79"
+        "b6568b1df2743f7b47ee964b99752886d60c175f7730bbb3d9d9d152e576d820"
+        "6c11a0360e6924992eb50aa6d9421e06cc23c792cdd0efa0b1de0e7811672a2d" },
+    { 4096,
+        "e201df72c3954922f6d9f293a8610285464a3da8ee24da9d0d6c2039ba7b3582"
+        "ca392d621b478993fb7a7e01814069dfe6180e70ca0ab4de5b1e0e16e8efa5f8"
+        "258bd67e307a1b41c0d44447e27c4fd43cef9b737a664bcf05f9fb186e7a0708"
+        "80122d4284b6787b611ab732778ed6d00912b0500d63b6aeef012eb37c9a25a0"
+        "6e2fa23585c1910e76abdf7cdebf0e668232c7f070ba6910ace54e0790730cff"
+        "33834f5b8e84ce365e1c50c04059916b41abee9abfc6faf0ab4f3ad63bd79760"
+        "2726f4528a9c345753da58a355a1101b9311843b34743abde5b35680fee403d4"
+        "381dde883f4a042828350b2ef061e03e8d9749cf3c2b0e0c7177a7e209bd5267",
+        "cc0569062225067c0cf07d3af6367e28d3ab5cdd93d197f0430aca44dad6221a"
+        "303654e0dab495cf02882d5bd01ea8a299def9eeeb38326025fd8c3a0a40e5ba"
+        "2c0a27b186d9d0618e321e2ffc17729058fc6ed80dd1d07df3a253cca468c2b4"
+        "ccd5f5c32a027664f6a0a7a30e22d7f76bc69c6d4231a9b19743b94fbeae41ba"
+        "91c1f94b537541dc9b57091bf9c0efbf03ed842bdba866a64c0808f7a61fc170"
+        "179c036cf91ef8902f51ae101c559b3130f27312e80afc388172c21ce3159401"
+        "2c92d8d265693fbe73b34e33ff541428ea2dbdb93e494cedd243d4ce4e4e62d6"
+        "4c979ff3ea1ed84209f3dbbc8557395866f9a3bbd81599441dcec16bfadc5505",
+        "8f742c204ce14acaf0c616cb323cef4538ebe51004cbd5b4bb62eb52058bbe9f"
+        "28b97893b040802674b36e58a8b9ec8062896a1aad8e99403f2a55c0b9d04bc0"
+        "31315ac767c4e469539672de8e295a7b1feec51c95ca008885faae61a81a4abe"
+        "68f8a3afa7610194bb55b9f0b4145b3e2697216b7bda03fecfe1391a8e141fa4"
+        "89582f4e9835af5f425c32ae97d55b2ddc4db31801e8e68817147927385ff454"
+        "ddc1111d4b7a89fc77b5c03ae2c6f4ba1cd71ed6c6644ca15850ec29dd1a349e"
+        "1a76ca1cd789b054502332fca6f6a3f000d4410112dc76584cf900b058b15932"
+        "c46db84c5d14b0452c8ad69a490e27a0a321d63c04356526aa605db560dd29f7"
+        "65f143d386f6554c104818426c9468723d9e787ff7a947692d8e3e119d18ab52"
+        "3320de8a1b3f87aaf29d7b332ea23df839b157de07e6bbd2517927f50464c9e3"
+        "ca60c95999baa1187919fad484202d67aa6b7b8c6de280923e6e55a209c8c13c"
+        "53495bc2f8f3acc770c710efe1a2afab43f258489eacfa89ca15817a225d1de5"
+        "a0920dc3e52750aae1d2cfe2b854821ccfa30c52fdf8d3fc92a68c4a1b33e276"
+        "99df4f2f5f2c7259aff3ae2d9b610804b990295f6de3bae4e0e7b19a5efda2ae"
+        "8e5bba06abbe1f8c91642292a7ae1a982f1599a2a0d48a475b356b687ca0279e"
+        "d12c89c8c840dc7ea642b88447b5af92d0384305af0c3d91327d88be2e5d4ed" },
+};
+
+void test_rsa(int bits)
+{
+    const RSATestKey* key = NULL;
+    for (size_t i = 0; i < sizeof(rsa_test_keys) / sizeof(rsa_test_keys[0]); i++)
+        if (rsa_test_keys[i].bits == bits)
+            key = &rsa_test_keys[i];
+    if (NULL == key) {
+        printf("no RSA test key with %d bits, use 2048 or 4096\n", bits);
+        return;
+    }
+    srand (rand_seed);
+
+    Bignum p, q, d;
+    p.fromHex(key->p);
+    q.fromHex(key->q);
+    d.fromHex(key->d);
+    Bignum n = p.mult(q);
+    Bignum one(1);
+    Bignum dP = d.mod(p.sub2(one));
+    Bignum dQ = d.mod(q.sub2(one));
+
+    // qInv = q^(-1) mod p: Lehmer's extended Euclid against q^(p-2) mod p
+    Bignum qInv;
+    double seconds_inv = read_timer();
+    q.mod_inverse(p, qInv);
+    seconds_inv = read_timer() - seconds_inv;
+    double seconds_fermat = read_timer();
+    Bignum qInv_fermat = q.mod_exp_sliding_Montgomery(p.sub2(Bignum(2)), p);
+    seconds_fermat = read_timer() - seconds_fermat;
+    printf("q^(-1) mod p: extended Euclid %lf, q^(p-2) mod p %lf\n", seconds_inv, seconds_fermat);
+    if (0 != Bignum::compare(qInv, qInv_fermat))
+        printf("the inverses differ!\n");
+    printf("\n");
+
+    Bignum c;
+    c.genBignum(bits - 1);
+    printf("  c = "); c.print(); printf("\n");
+
+    printf("RSA private operation. \n");
+    printf("           full modulus - sliding window, Montgomery product\n\n");
+    double seconds = read_timer();
+    Bignum m_full = c.mod_exp_sliding_Montgomery(d, n);
     seconds = read_timer() - seconds;
-    printf("re3 = "); re3.print(); printf("\n");
+    printf("m1 = "); m_full.print(); printf("\n");
     printf("\ntime = %lf\n\n", seconds);
-#if 0
-    printf("using m-ary (m=%d) method, Blakley shift add...\n\n", M_ARY);
+
+    printf("RSA private operation. \n");
+    printf("           CRT - two half-size exponentiations, Garner recombination\n\n");
+    double seconds_crt = read_timer();
+    Bignum m_crt;
+    if (!c.RSA_private_CRT(p, q, dP, dQ, qInv, m_crt))
+        printf("p or q is even!\n");
+    seconds_crt = read_timer() - seconds_crt;
+    printf("m2 = "); m_crt.print(); printf("\n");
+    printf("\ntime = %lf, speedup = %.2lf\n\n", seconds_crt, seconds / seconds_crt);
+
+    if (0 != Bignum::compare(m_full, m_crt))
+        printf("m2 differs from m1!\n");
+
+    // public operation, e = 65537 known at compile time or read at run time
+    printf("RSA public operation. \n");
+    printf("           e = 65537 at run time - binary method, Montgomery product\n\n");
     seconds = read_timer();
-    Bignum re4 = M.mod_exp_binary_Blakley_shiftadd(exp, n);
+    Bignum c_runtime = m_crt.mod_exp_binary_Montgomery(Bignum(65537), n);
+    seconds = read_timer() - seconds;
+    printf("time = %lf\n\n", seconds);
+
+    printf("RSA public operation. \n");
+    printf("           e = 65537 at compile time - 16 squarings, 1 multiplication that leaves the Montgomery domain\n\n");
+    double seconds_const = read_timer();
+    Bignum c_const = m_crt.mod_exp_const<65537>(n);
+    seconds_const = read_timer() - seconds_const;
+    printf("time = %lf, speedup = %.2lf\n\n", seconds_const, seconds / seconds_const);
+
+    if (0 != Bignum::compare(c_const, c) || 0 != Bignum::compare(c_runtime, c))
+        printf("m2^e differs from c!\n");
+}
+
+
+// benchmark: seeded inputs, one warm-up run, then repeated trials per
+// (operation, size); a trial repeats fast operations for BENCH_TRIAL_SECONDS
+struct BenchResult {
+    string op;
+    int bits;
+    int trials;
+    long reps;          // runs per trial
+    double median;      // seconds per run
+    double p99;
+    OpCounters counts;  // of one run, if compiled in
+};
+
+template <class Op>
+static BenchResult bench_case(const string& name, int bits, Op op)
+{
+    BenchResult res;
+    res.op = name;
+    res.bits = bits;
+
+    // warm-up, then double the runs per trial until a trial takes
+    // BENCH_TRIAL_SECONDS (one run of a slow operation is enough)
+    op();
+    res.reps = 1;
+    for (;;) {
+        double seconds = read_timer();
+        for (long r = 0; r < res.reps; r++)
+            op();
+        if (read_timer() - seconds >= BENCH_TRIAL_SECONDS)
+            break;
+        res.reps <<= 1;
+    }
+
+    vector<double> samples;
+    double start = read_timer();
+    while (samples.size() < BENCH_MAX_TRIALS
+           && (samples.size() < BENCH_MIN_TRIALS || read_timer() - start < BENCH_CASE_SECONDS)) {
+        double seconds = read_timer();
+        for (long r = 0; r < res.reps; r++)
+            op();
+        samples.push_back((read_timer() - seconds) / res.reps);
+    }
+    sort(samples.begin(), samples.end());
+    int k = static_cast<int>(samples.size());
+    res.trials = k;
+    res.median = (k & 1) ? samples[k/2] : 0.5 * (samples[k/2 - 1] + samples[k/2]);
+    res.p99 = samples[(99*k + 99) / 100 - 1];     // nearest rank, the maximum below 100 trials
+
+    op_counters_reset();
+    if (op_counters_enabled)
+        op();
+    res.counts = op_counters;
+    return res;
+}
+
+static void bench_print(const BenchResult& res)
+{
+    double limbs = (res.bits + 63) >> 6;
+    printf("%-24s %6d %7d %14.3f %14.3f %14.1f %12.3f\n", res.op.c_str(), res.bits, res.trials,
+           1e6 * res.median, 1e6 * res.p99, 1.0 / res.median, 1e9 * res.median / (limbs * limbs));
+    fflush(stdout);
+}
+
+static bool bench_write_json(const char* path, const vector<BenchResult>& results)
+{
+    FILE* f = fopen(path, "w");
+    if (NULL == f)
+        return false;
+    fprintf(f, "{\n  \"seed\": %u,\n  \"kernels\": \"%s\",\n", rand_seed, word_kernels->name);
+    fprintf(f, "  \"karatsuba_threshold\": %d,\n  \"toom3_threshold\": %d,\n",
+            karatsuba_threshold, toom3_threshold);
+    fprintf(f, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& res = results[i];
+        double limbs = (res.bits + 63) >> 6;
+        fprintf(f, "    {\"op\": \"%s\", \"bits\": %d, \"limbs\": %d, \"trials\": %d, \"reps\": %ld, "
+                "\"median_ns\": %.1f, \"p99_ns\": %.1f, \"ops_per_s\": %.3f, \"ns_per_limb2\": %.4f",
+                res.op.c_str(), res.bits, static_cast<int>(limbs), res.trials, res.reps,
+                1e9 * res.median, 1e9 * res.p99, 1.0 / res.median,
+                1e9 * res.median / (limbs * limbs));
+        if (op_counters_enabled) {
+            fprintf(f, ", \"counts\": {");
+            for (int j = 0; j < OP_COUNTERS; j++)
+                fprintf(f, "\"%s\": %llu%s", op_counter_names[j],
+                        static_cast<unsigned long long>(res.counts.count[j]),
+                        (j + 1 < OP_COUNTERS) ? ", " : "}");
+        }
+        fprintf(f, "}%s\n", (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return 0 == fclose(f);
+}
+
+// random number of exactly bits bits, odd if asked (rand() has 31 bits, so
+// genBignum leaves the top bit of a word clear)
+static Bignum bench_operand(int bits, bool odd)
+{
+    int words = (bits + 63) >> 6;
+    vector<uint64_t> w(words);
+    Bignum x;
+    x.genBignum(bits);
+    x.toWords64(&w[0], words);
+    w[(bits - 1) >> 6] |= static_cast<uint64_t>(1) << ((bits - 1) & 63);
+    if (odd)
+        w[0] |= 1;
+    x.fromWords64(&w[0], words);
+    return x;
+}
+
+// sizes from BENCH_MIN_BITS doubling up to max_bits; the inputs of each size
+// come from srand(seed + bits), so they do not depend on the range
+void bench(int max_bits, const char* json_path)
+{
+    vector<int> sizes;
+    for (int bits = BENCH_MIN_BITS; bits < max_bits; bits <<= 1)
+        sizes.push_back(bits);
+    sizes.push_back(max_bits);
+
+    printf("seed = %u, kernels = %s, %d to %d runs of at least %.0lf ms per case\n\n", rand_seed,
+           word_kernels->name, BENCH_MIN_TRIALS, BENCH_MAX_TRIALS, 1e3 * BENCH_TRIAL_SECONDS);
+    printf("%-24s %6s %7s %14s %14s %14s %12s\n", "op", "bits", "trials",
+           "median (us)", "p99 (us)", "ops/s", "ns/limb^2");
+    vector<BenchResult> results;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        int bits = sizes[s];
+        srand(rand_seed + bits);
+        Bignum n = bench_operand(bits, true);
+        Bignum a = bench_operand(bits, false).mod(n);
+        Bignum b = bench_operand(bits, false).mod(n);
+        Bignum wide = bench_operand(2*bits, false);
+        Bignum exp = bench_operand(bits, false);
+        Bignum r;
+
+        results.push_back(bench_case("mult", bits, [&]() { r = a.mult(b); }));
+        bench_print(results.back());
+        results.push_back(bench_case("square", bits, [&]() { r = a.square(); }));
+        bench_print(results.back());
+        results.push_back(bench_case("mod", bits, [&]() { r = wide.mod(n); }));
+        bench_print(results.back());
+        results.push_back(bench_case("multMod", bits, [&]() { r = a.multMod(b, n); }));
+        bench_print(results.back());
+        results.push_back(bench_case("Blakley_shiftadd", bits,
+                                     [&]() { r = Bignum::Blakley_shiftadd(a, b, n); }));
+        bench_print(results.back());
+        results.push_back(bench_case("gcd", bits, [&]() { r = a.gcd(n); }));
+        bench_print(results.back());
+        results.push_back(bench_case("mod_inverse", bits, [&]() { a.mod_inverse(n, r); }));
+        bench_print(results.back());
+
+        // small public exponents, known at compile time or read at run time
+        Bignum e3(3), e17(17), e65537(65537);
+        results.push_back(bench_case("pow_const_3", bits, [&]() { r = a.mod_exp_const<3>(n); }));
+        bench_print(results.back());
+        results.push_back(bench_case("pow_binary_3", bits,
+                                     [&]() { r = a.mod_exp_binary_Montgomery(e3, n); }));
+        bench_print(results.back());
+        results.push_back(bench_case("pow_const_17", bits, [&]() { r = a.mod_exp_const<17>(n); }));
+        bench_print(results.back());
+        results.push_back(bench_case("pow_binary_17", bits,
+                                     [&]() { r = a.mod_exp_binary_Montgomery(e17, n); }));
+        bench_print(results.back());
+        results.push_back(bench_case("pow_const_65537", bits, [&]() { r = a.mod_exp_const<65537>(n); }));
+        bench_print(results.back());
+        results.push_back(bench_case("pow_binary_65537", bits,
+                                     [&]() { r = a.mod_exp_binary_Montgomery(e65537, n); }));
+        bench_print(results.back());
+        if (0 != Bignum::compare(r, a.mod_exp_const<65537>(n)))
+            printf("pow_binary_65537 differs from pow_const_65537!\n");
+
+        Bignum expected = a.mod_exp_sliding_Montgomery(exp, n);
+        for (int i = 0; i < exp_method_count; i++) {
+            const ExpMethod& m = exp_methods[i];
+            results.push_back(bench_case(string("exp_") + m.name, bits,
+                                         [&]() { exp_method_run(m, a, exp, n, r); }));
+            bench_print(results.back());
+            if (0 != Bignum::compare(r, expected))
+                printf("exp_%s differs from exp_sliding_Montgomery!\n", m.name);
+        }
+    }
+
+    if (NULL != json_path) {
+        if (bench_write_json(json_path, results))
+            printf("\nresults written to %s\n", json_path);
+        else
+            printf("\ncannot write %s\n", json_path);
+    }
+}
+
+// one prime with `threads` sieving threads, then the same prime checked with
+// the full number of rounds again
+void test_prime(int bits, int threads)
+{
+    printf("prime generation: %d threads, %d sieve primes, windows of %d odd candidates\n\n",
+           threads, SIEVE_PRIMES, SIEVE_WINDOW);
+    vector<PrimeStats> stats;
+    double seconds = read_timer();
+    Bignum p = gen_prime(bits, threads, &stats);
     seconds = read_timer() - seconds;
-    printf("re4 = "); re4.print(); printf("\n");
+    printf("p = "); p.print(); printf("\n");
     printf("\ntime = %lf\n\n", seconds);
-#endif
+
+    for (int id = 0; id < threads; id++) {
+        const PrimeStats& st = stats[id];
+        printf("thread %d: %ld windows, %ld candidates, %ld tested (%.1lf%%), %ld rounds\n",
+               id, st.windows, st.candidates, st.tests,
+               (st.candidates > 0) ? 100.0 * st.tests / st.candidates : 0.0, st.rounds);
+    }
+
+    SecureRandom rng;
+    PrimeStats check = PrimeStats();
+    if (p.getTotalBits() != bits || !miller_rabin(p, miller_rabin_rounds(bits), rng, check))
+        printf("p is not a %d-bit prime!\n", bits);
 }
 
+// streaming batch from in ("-" is stdin) to out (NULL is stdout) with
+// `threads` workers; the statistics go to stderr, stdout may be the results
+int run_stream(const char* in_path, const char* out_path, StreamFormat format, int threads)
+{
+    StreamInput in;
+    if (!in.open(in_path)) {
+        fprintf(stderr, "cannot read %s\n", in_path);
+        return 1;
+    }
+    FILE* out = (NULL == out_path) ? stdout : fopen(out_path, (STREAM_HEX == format) ? "w" : "wb");
+    if (NULL == out) {
+        fprintf(stderr, "cannot write %s\n", out_path);
+        return 1;
+    }
+    vector<char> out_buffer(STREAM_READ_BYTES);
+    setvbuf(out, &out_buffer[0], _IOFBF, out_buffer.size());
+
+    const char* error;
+    StreamPipeline pipeline(format, out, threads);
+    double seconds = read_timer();
+    long records = pipeline.run(in, threads, &error);
+    seconds = read_timer() - seconds;
+    bool failed = pipeline.failed();
+    if (stdout == out)
+        setvbuf(out, NULL, _IONBF, 0);  // out_buffer goes away
+    else if (0 != fclose(out))
+        failed = true;
+
+    fprintf(stderr, "stream: %ld records, %d workers, time = %lf, %.1lf records/s\n",
+            records, threads, seconds, (seconds > 0) ? records / seconds : 0.0);
+    if (NULL != error)
+        fprintf(stderr, "record %ld: %s\n", records + 1, error);
+    if (failed)
+        fprintf(stderr, "cannot write %s\n", (NULL == out_path) ? "stdout" : out_path);
+    return (NULL != error || failed) ? 1 : 0;
+}
 
 int main(int argc, char** argv)
 {
-    printf("bit sizes = %d bits\n\n", K);
-    test8();
+    int bits = 1024;
+    bool rsa = false;
+    bool lanes = false;
+    bool prime = false;
+    const char* stream_in = NULL;
+    const char* stream_out = NULL;
+    StreamFormat stream_format = STREAM_HEX;
+    bool format_ok = true;
+    int batch = 0;
+    bool benchmark = false;
+    const char* json_path = NULL;
+    bool seeded = false;
+    const char* force_kernels = NULL;
+    int threads = static_cast<int>(thread::hardware_concurrency());
+    if (threads < 1)
+        threads = 1;
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "-k") && i + 1 < argc)
+            karatsuba_threshold = atoi(argv[++i]);
+        else if (0 == strcmp(argv[i], "-t") && i + 1 < argc)
+            toom3_threshold = atoi(argv[++i]);
+        else if (0 == strcmp(argv[i], "-w") && i + 1 < argc)
+            window_width = atoi(argv[++i]);
+        else if (0 == strcmp(argv[i], "-r"))
+            rsa = true;
+        else if (0 == strcmp(argv[i], "-l"))
+            lanes = true;
+        else if (0 == strcmp(argv[i], "-P"))
+            prime = true;
+        else if (0 == strcmp(argv[i], "-i") && i + 1 < argc)
+            stream_in = argv[++i];
+        else if (0 == strcmp(argv[i], "-o") && i + 1 < argc)
+            stream_out = argv[++i];
+        else if (0 == strcmp(argv[i], "-f") && i + 1 < argc) {
+            i++;
+            format_ok = (0 == strcmp(argv[i], "hex") || 0 == strcmp(argv[i], "bin"));
+            stream_format = (0 == strcmp(argv[i], "bin")) ? STREAM_BIN : STREAM_HEX;
+        }
+        else if (0 == strcmp(argv[i], "-b") && i + 1 < argc)
+            batch = atoi(argv[++i]);
+        else if (0 == strcmp(argv[i], "-p") && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (0 == strcmp(argv[i], "-c") && i + 1 < argc)
+            comb_teeth = atoi(argv[++i]);
+        else if (0 == strcmp(argv[i], "-v") && i + 1 < argc)
+            comb_tables = atoi(argv[++i]);
+        else if (0 == strcmp(argv[i], "-s") && i + 1 < argc) {
+            rand_seed = static_cast<unsigned int>(strtoul(argv[++i], NULL, 0));
+            seeded = true;
+        }
+        else if (0 == strcmp(argv[i], "-K") && i + 1 < argc)
+            force_kernels = argv[++i];
+        else if (0 == strcmp(argv[i], "-B"))
+            benchmark = true;
+        else if (0 == strcmp(argv[i], "-j") && i + 1 < argc)
+            json_path = argv[++i];
+        else
+            bits = atoi(argv[i]);
+    }
+    if (bits < 2 || bits > MAX_BITS || karatsuba_threshold < 4 || toom3_threshold < 16
+        || window_width < 0 || window_width > MAX_WINDOW
+        || comb_teeth < 1 || comb_teeth > MAX_TEETH || comb_tables < 1 || comb_tables > MAX_TABLES
+        || batch < 0 || threads < 1 || threads > MAX_THREADS
+        || (prime && bits < MIN_PRIME_BITS) || !format_ok) {
+        printf("usage: %s [-k karatsuba_threshold] [-t toom3_threshold] [-w window]\n"
+               "       [-c comb_teeth] [-v comb_tables] [-s seed] [-r] [-l] [-b jobs [-p threads]]\n"
+               "       [-P [-p threads]] [-i file [-o file] [-f hex|bin] [-p threads]]\n"
+               "       [-K kernels] [-B [-j file]] [bits]\n", argv[0]);
+        printf("       bits in [2, %d], thresholds in 64-bit words, at least 4 and 16\n", MAX_BITS);
+        printf("       window in [1, %d], 0 picks it from the exponent length\n", MAX_WINDOW);
+        printf("       comb: 2^teeth entries per table, teeth in [1, %d], tables in [1, %d]\n",
+               MAX_TEETH, MAX_TABLES);
+        printf("       -r: RSA private operation, full modulus against CRT (2048 or 4096 bits)\n");
+        printf("       -l: independent exponentiations in SIMD lanes, in lockstep\n");
+        printf("       -b: batch of jobs on a pool of threads in [1, %d], default one per core\n",
+               MAX_THREADS);
+        printf("       -P: random prime of bits bits, at least %d, sieved on -p threads\n",
+               MIN_PRIME_BITS);
+        printf("       -i: streaming batch, (base, exponent, modulus) records from file or\n"
+               "           stdin (-) to -o file or stdout, -f hex (default) or bin records\n");
+        printf("       -s: seed of the random inputs, default the time (the benchmark: %d)\n",
+               BENCH_SEED);
+        printf("       -B: benchmark from %d bits up to bits, -j writes the results as JSON\n",
+               BENCH_MIN_BITS);
+        printf("       -K: kernels instead of the fastest ones of the CPU, comma separated:\n"
+               "           generic or adx (words), scalar, avx2 or ifma (lanes)\n");
+        return 1;
+    }
+    if (!select_kernels(force_kernels))
+        return 1;
+    if (!seeded)
+        rand_seed = benchmark ? BENCH_SEED : static_cast<unsigned int>(time(NULL));
+    if (benchmark) {
+        bench(bits, json_path);
+        return 0;
+    }
+    if (NULL != stream_in)
+        return run_stream(stream_in, stream_out, stream_format, threads);
+    printf("bit sizes = %d bits\n", bits);
+    printf("kernels = %s, lanes = %s\n\n", word_kernels->name, lane_engine->name);
+    if (rsa)
+        test_rsa(bits);
+    else if (lanes)
+        test_lanes(bits);
+    else if (prime)
+        test_prime(bits, threads);
+    else if (batch > 0)
+        test_batch(bits, batch, threads);
+    else
+        test8(bits);
     return 0;
 }
 